@@ -12,11 +12,23 @@
 
 namespace WeightedLowess {
 
+/**
+ * Initialization of the robustness iterations in `compute()`.
+ *
+ * - `NONE`: the first fit is performed without any robustness weights.
+ * - `ROBUST_WEIGHTS`: the first fit uses the robustness weights that are supplied in the `robust_weights` array (or `Results::robust_weights`) when calling `compute()`.
+ * - `FITTED`: robustness weights are first computed from the residuals of the fitted values that are supplied in the `fitted` array (or `Results::fitted`) when calling `compute()`.
+ *   These weights are then used in the first fit, as described for `ROBUST_WEIGHTS`.
+ */
+enum class WarmStart { NONE, ROBUST_WEIGHTS, FITTED };
+
 /**
  * @brief Options for `compute()`.
  * @tparam Data_ Floating-point type for the data.
+ * @tparam Accumulate_ Floating-point type for accumulating sums in the local regressions, the median absolute deviation and the interpolation.
+ * This can be set to a more precise type than `Data_`, e.g., to store the data as `float` to save memory while performing all accumulations in `double` for accuracy.
  */
-template<typename Data_ = double>
+template<typename Data_ = double, typename Accumulate_ = Data_>
 struct Options {
     /**
      * Span of the smoothing window around each point.
@@ -66,6 +78,39 @@ struct Options {
      */
     int iterations = 3;
 
+    /**
+     * How to initialize the robustness iterations.
+     * By default, the first fit ignores the robustness weights, and each point's robustness weight is then computed from its residual.
+     * Alternatively, a previous fit (e.g., on a slightly modified version of the same data) can be used as a warm start, see `WarmStart` for details.
+     * This is typically closer to the final robust fit and reduces the number of iterations required to reach it. 
+     * It is also possible to perform more iterations on an existing result by calling `compute()` with `WarmStart::ROBUST_WEIGHTS`.
+     *
+     * Note that the warm-started fit is still followed by `Options::iterations` robustness iterations.
+     * If points were added to the data, their initial robustness weights (or fitted values) should be filled in by the caller, e.g., with 1.
+     */
+    WarmStart warm_start = WarmStart::NONE;
+
+    /**
+     * Tolerance for early termination of the robustness iterations.
+     * If set, the iterations stop once the maximum absolute change in the robustness weights between consecutive iterations is no greater than this value,
+     * as any further iterations would not substantially change the fit.
+     * In such cases, the returned robustness weights are those computed from the final fitted values.
+     * The number of iterations that were actually performed is reported by `compute()`.
+     * If unset, all `Options::iterations` are performed.
+     */
+    std::optional<Data_> convergence_tolerance;
+
+    /**
+     * Threshold for incremental robustness iterations.
+     * If set, each robustness iteration after the first only refits the anchors with at least one point in their window where the robustness weight changed by more than this threshold since the previous iteration.
+     * The fitted values for all other anchors (and the interpolated values between them) are carried over from the previous iteration.
+     * This can greatly reduce the computational work when the robustness weights converge quickly, e.g., for clean data with a few outliers,
+     * at the cost of ignoring small changes in the robustness weights.
+     * If no anchors are affected, the remaining iterations are skipped altogether as they would not change the fit.
+     * If unset, all anchors are refitted in every iteration.
+     */
+    std::optional<Data_> incremental_threshold;
+
     /**
      * Delta value used to identify anchors.
      * Seeds are identified greedily, by walking through the ordered x-coordinate values and marking a point `y` as a anchor if there are no anchors in `[y - delta, y]`.
@@ -89,6 +134,41 @@ struct Options {
      */
     bool frequency_weights = true;
 
+    /**
+     * Whether to find the window for each anchor by a binary search on a prefix sum of the frequency weights.
+     * This is faster than the default approach, which adds the weights of one point at a time until the span is reached,
+     * when there are many anchors with large windows, e.g., when `Options::delta` is zero.
+     * However, the window boundaries may occasionally differ from the default approach due to round-off error,
+     * when the sum of non-integer weights in a window is very close to the span.
+     * Only used if `weights` are provided and `Options::frequency_weights = true`.
+     */
+    bool search_windows = false;
+
+    /**
+     * Whether to check if the x-coordinates lie on a regular grid, i.e., are equally spaced, as is often the case for time series or binned data.
+     * If so, `define_windows()` precomputes the tricube weights for the symmetric window that is shared by all interior anchors,
+     * and the local regression for each of those anchors is computed by convolving this stencil with the y-values.
+     * This is faster than the default approach as the tricube weights do not need to be recomputed for each anchor.
+     * Anchors near the edges of the grid, or with a different window for any other reason, are processed as usual.
+     * If the x-coordinates are not equally spaced, this option has no effect.
+     *
+     * The fitted values are only approximately equal to those from the default approach.
+     * The stencil's weights are computed from the grid step rather than the observed x-coordinates,
+     * and the stencil is also used for interior windows that differ from it due to round-off error in the x-coordinates,
+     * e.g., a window that omits one of the end points with near-zero tricube weight, or a window distance that differs by a few ulps.
+     * The resulting differences are small relative to the y-values but are not guaranteed to be zero.
+     */
+    bool regular_grid = false;
+
+    /**
+     * Whether to use sliding power sums to compute the local regression at each anchor.
+     * On either side of an anchor, the tricube weight is a polynomial in the x-coordinates, so the regression can be assembled from running sums that are updated as the window moves from one anchor to the next.
+     * This avoids a pass over the window for each anchor, making it much faster when there are many anchors with large windows, e.g., when `Options::delta` is zero.
+     * The fitted values are the same as those from the default approach, up to round-off error. 
+     * Note that `compute_batch()` only uses this option in the robustness iterations.
+     */
+    bool fast_sums = false;
+
     /**
      * Number of threads to use for various steps.
      * This should be a positive integer.
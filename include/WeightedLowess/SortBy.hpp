@@ -5,12 +5,15 @@
 #include <numeric>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <type_traits>
 #include <initializer_list>
 #include <cstddef>
 
 #include "sanisizer/sanisizer.hpp"
 
+#include "parallelize.hpp"
 #include "utils.hpp"
 
 /**
@@ -20,6 +23,259 @@
 
 namespace WeightedLowess {
 
+/**
+ * @cond
+ */
+namespace internal {
+
+/*
+ * Maximum number of ascending runs for which we merge the runs instead of
+ * sorting from scratch. This targets nearly-sorted inputs, e.g., time-stamped
+ * data with a few out-of-order batches, where merging is cheaper than the
+ * multiple passes of a radix sort.
+ */
+constexpr std::size_t sort_max_merge_runs = 64;
+
+/*
+ * Minimum number of points for a radix sort. Below this, the fixed cost of the
+ * histograms is not worth it and we just use a comparison sort.
+ */
+constexpr std::size_t sort_min_radix_size = 1024;
+
+template<typename Sortable_>
+constexpr bool is_radix_sortable() {
+    if constexpr(std::is_floating_point<Sortable_>::value) {
+        return std::numeric_limits<Sortable_>::is_iec559 && (sizeof(Sortable_) == 4 || sizeof(Sortable_) == 8);
+    } else {
+        return std::is_integral<Sortable_>::value && !std::is_same<Sortable_, bool>::value && sizeof(Sortable_) <= 8;
+    }
+}
+
+template<typename Sortable_>
+using RadixKey = typename std::conditional<sizeof(Sortable_) <= 4, std::uint32_t, std::uint64_t>::type;
+
+template<typename Key_>
+struct RadixBuffers {
+    std::vector<Key_> keys, key_buffer, varying;
+};
+
+/*
+ * Converting a value into an unsigned integer whose ordering is the same as
+ * that of the original values. For IEEE floats, this involves flipping all
+ * bits of negative values and the sign bit of non-negative values.
+ */
+template<typename Sortable_>
+RadixKey<Sortable_> to_radix_key(const Sortable_ val) {
+    typedef RadixKey<Sortable_> Key;
+    constexpr Key sign_bit = static_cast<Key>(1) << (std::numeric_limits<Key>::digits - 1);
+    if constexpr(std::is_floating_point<Sortable_>::value) {
+        static_assert(sizeof(Key) == sizeof(Sortable_));
+        Key bits;
+        std::memcpy(&bits, &val, sizeof(Key));
+        return ((bits & sign_bit) ? ~bits : (bits | sign_bit));
+    } else if constexpr(std::is_signed<Sortable_>::value) {
+        return static_cast<Key>(static_cast<typename std::make_signed<Key>::type>(val)) ^ sign_bit;
+    } else {
+        return static_cast<Key>(val);
+    }
+}
+
+/*
+ * Stable LSD radix sort of 'keys' with 8-bit digits, carrying 'indices' along.
+ * Each pass is parallelized by computing per-chunk histograms, so that each
+ * chunk can scatter its keys to its own region of each bucket. Passes are
+ * skipped for digits that are the same for all keys, e.g., the exponent bits
+ * for data with a narrow range.
+ */
+template<typename Key_, typename Index_>
+void radix_sort(
+    const std::size_t num_points,
+    std::vector<Key_>& keys,
+    std::vector<Index_>& indices,
+    std::vector<Key_>& key_buffer,
+    std::vector<Index_>& index_buffer,
+    std::vector<Key_>& varying,
+    std::vector<std::size_t>& offsets,
+    const int num_threads
+) {
+    constexpr int radix_bits = 8;
+    constexpr std::size_t num_buckets = static_cast<std::size_t>(1) << radix_bits;
+    constexpr Key_ digit_mask = static_cast<Key_>(num_buckets - 1);
+
+    const auto num_chunks = count_chunks(num_points, num_threads);
+    sanisizer::resize(varying, num_chunks);
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = chunk_start(num_points, num_chunks, c);
+            const auto last = chunk_start(num_points, num_chunks, c + 1);
+            Key_ diff = 0;
+            for (auto i = first; i < last; ++i) {
+                diff |= keys[i] ^ keys[0];
+            }
+            varying[c] = diff;
+        }
+    });
+    Key_ all_varying = 0;
+    for (std::size_t c = 0; c < num_chunks; ++c) {
+        all_varying |= varying[c];
+    }
+
+    sanisizer::resize(key_buffer, num_points);
+    sanisizer::resize(index_buffer, num_points);
+    sanisizer::resize(offsets, sanisizer::product<std::size_t>(num_chunks, num_buckets));
+
+    for (int shift = 0; shift < std::numeric_limits<Key_>::digits; shift += radix_bits) {
+        if (((all_varying >> shift) & digit_mask) == 0) {
+            continue;
+        }
+
+        parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+            for (auto c = start, end = start + length; c < end; ++c) {
+                const auto first = chunk_start(num_points, num_chunks, c);
+                const auto last = chunk_start(num_points, num_chunks, c + 1);
+                const auto counts = offsets.data() + c * num_buckets;
+                std::fill_n(counts, num_buckets, 0);
+                for (auto i = first; i < last; ++i) {
+                    ++counts[(keys[i] >> shift) & digit_mask];
+                }
+            }
+        });
+
+        // Converting counts into offsets, in bucket-major and chunk-minor order for stability.
+        std::size_t running = 0;
+        for (std::size_t b = 0; b < num_buckets; ++b) {
+            for (std::size_t c = 0; c < num_chunks; ++c) {
+                auto& current = offsets[c * num_buckets + b];
+                const auto count = current;
+                current = running;
+                running += count;
+            }
+        }
+
+        parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+            for (auto c = start, end = start + length; c < end; ++c) {
+                const auto first = chunk_start(num_points, num_chunks, c);
+                const auto last = chunk_start(num_points, num_chunks, c + 1);
+                const auto positions = offsets.data() + c * num_buckets;
+                for (auto i = first; i < last; ++i) {
+                    const auto dest = positions[(keys[i] >> shift) & digit_mask]++;
+                    key_buffer[dest] = keys[i];
+                    index_buffer[dest] = indices[i];
+                }
+            }
+        });
+
+        keys.swap(key_buffer);
+        indices.swap(index_buffer);
+    }
+}
+
+/*
+ * Finding the start of each ascending run in 'x'. We give up if there are more
+ * than 'max_runs' runs, in which case we return false and 'run_starts' is not
+ * filled. Otherwise, 'run_starts' contains the start of each run plus 'num_points'.
+ */
+template<typename Sortable_>
+bool find_sorted_runs(
+    const std::size_t num_points,
+    const Sortable_* const x,
+    const std::size_t max_runs,
+    std::vector<std::size_t>& run_starts,
+    std::vector<std::size_t>& chunk_offsets,
+    const int num_threads
+) {
+    const auto num_chunks = count_chunks(num_points, num_threads);
+    sanisizer::resize(chunk_offsets, sanisizer::sum<std::size_t>(num_chunks, 1));
+    chunk_offsets[0] = 0;
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = std::max(chunk_start(num_points, num_chunks, c), static_cast<std::size_t>(1));
+            const auto last = chunk_start(num_points, num_chunks, c + 1);
+            std::size_t count = 0;
+            for (auto i = first; i < last && count < max_runs; ++i) { // no need to keep counting once we exceed the limit.
+                count += (x[i] < x[i - 1]);
+            }
+            chunk_offsets[c + 1] = count;
+        }
+    });
+
+    for (std::size_t c = 0; c < num_chunks; ++c) {
+        chunk_offsets[c + 1] += chunk_offsets[c];
+    }
+    const auto num_runs = chunk_offsets[num_chunks] + 1;
+    if (num_runs > max_runs) {
+        return false;
+    }
+
+    sanisizer::resize(run_starts, num_runs + 1);
+    run_starts[0] = 0;
+    run_starts[num_runs] = num_points;
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = std::max(chunk_start(num_points, num_chunks, c), static_cast<std::size_t>(1));
+            const auto last = chunk_start(num_points, num_chunks, c + 1);
+            auto run = chunk_offsets[c] + 1;
+            for (auto i = first; i < last; ++i) {
+                if (x[i] < x[i - 1]) {
+                    run_starts[run] = i;
+                    ++run;
+                }
+            }
+        }
+    });
+
+    return true;
+}
+
+/*
+ * Stable bottom-up merge of the sorted runs of the permutation vector. Each
+ * level merges adjacent pairs of runs in parallel.
+ */
+template<typename Sortable_, typename Index_>
+void merge_sorted_runs(
+    const Sortable_* const x,
+    std::vector<std::size_t>& run_starts,
+    std::vector<Index_>& permutation,
+    std::vector<Index_>& buffer,
+    const int num_threads
+) {
+    const auto num_points = permutation.size();
+    sanisizer::resize(buffer, num_points);
+    auto compare = [&](const Index_ left, const Index_ right) -> bool { return x[left] < x[right]; };
+
+    auto num_runs = run_starts.size() - 1;
+    while (num_runs > 1) {
+        const auto num_pairs = num_runs / 2 + num_runs % 2;
+        parallelize(num_threads, num_pairs, [&](const int, const std::size_t start, const std::size_t length) {
+            for (auto p = start, end = start + length; p < end; ++p) {
+                const auto first = run_starts[2 * p];
+                const auto middle = run_starts[std::min(2 * p + 1, num_runs)];
+                const auto last = run_starts[std::min(2 * p + 2, num_runs)];
+                std::merge(
+                    permutation.begin() + first,
+                    permutation.begin() + middle,
+                    permutation.begin() + middle,
+                    permutation.begin() + last,
+                    buffer.begin() + first,
+                    compare
+                );
+            }
+        });
+
+        for (std::size_t p = 0; p < num_pairs; ++p) {
+            run_starts[p] = run_starts[2 * p];
+        }
+        run_starts[num_pairs] = num_points;
+        num_runs = num_pairs;
+        permutation.swap(buffer);
+    }
+}
+
+}
+/**
+ * @endcond
+ */
+
 /**
  * @brief Utility class for sorting on a covariate.
  *
@@ -28,44 +284,109 @@ namespace WeightedLowess {
  * use `permute()` to apply that permutation to the various arrays of x-coordinates, y-coordinates and weights (if applicable);
  * calculate the fitted values from the permuted arrays with `compute()`, now that the x-coordinates are sorted;
  * and then use `unpermute()` on the results of the fit, to obtain fitted values for the points in their original (pre-sort) order.
+ *
+ * @tparam Index_ Integer type of the permutation indices.
+ * This should be large enough to hold the number of points.
+ * Using a smaller type (e.g., `std::uint32_t`) reduces the memory usage of the permutation.
  */
-class SortBy {
+template<typename Index_>
+class BasicSortBy {
 private:
-    std::vector<std::size_t> my_permutation;
+    std::vector<Index_> my_permutation;
+    std::size_t my_num_points = 0; // my_permutation is not filled if the input is already sorted.
     bool my_sorted = true;
 
+    // Scratch buffers for set(), kept so that repeated calls don't need to reallocate.
+    std::vector<std::size_t> my_run_starts, my_chunk_offsets, my_bucket_offsets;
+    std::vector<Index_> my_buffer;
+    internal::RadixBuffers<std::uint32_t> my_radix32;
+    internal::RadixBuffers<std::uint64_t> my_radix64;
+
+    template<typename Key_>
+    internal::RadixBuffers<Key_>& radix_buffers() {
+        if constexpr(sizeof(Key_) <= 4) {
+            return my_radix32;
+        } else {
+            return my_radix64;
+        }
+    }
+
 public:
     /**
      * @tparam Sortable_ Sortable type.
      * @param num_points Number of points.
      * @param[in] x Pointer to an array of sortable values, typically x-coordinates for the dataset.
+     * @param num_threads Number of threads to use.
      */
     template<typename Sortable_>
-    SortBy(const std::size_t num_points, const Sortable_* const x) {
-        set(num_points, x);
+    BasicSortBy(const std::size_t num_points, const Sortable_* const x, const int num_threads = 1) {
+        set(num_points, x, num_threads);
     }
 
     /**
      * Default constructor.
      * The object should not be used until `set()` is called.
      */
-    SortBy() = default;
+    BasicSortBy() = default;
 
     /**
+     * If `x` consists of a small number of ascending runs (e.g., nearly-sorted time-stamped data), the permutation is computed by merging the runs.
+     * Otherwise, floating-point and integer values are sorted with a radix sort, while other types are sorted with `std::sort()`.
+     * Tied values may be ordered arbitrarily in the permutation.
+     *
+     * The scratch buffers used for sorting are retained in this object,
+     * so repeated calls with the same (or fewer) number of points will not perform any further heap allocations.
+     *
      * @tparam Sortable_ Sortable type.
      * @param num_points Number of points.
      * @param[in] x Pointer to an array of sortable values, typically x-coordinates for the dataset.
+     * @param num_threads Number of threads to use.
      */
     template<typename Sortable_>
-    void set(const std::size_t num_points, const Sortable_* const x) {
-        if (num_points) {
-            my_sorted = std::is_sorted(x, x + num_points);
-            if (!my_sorted) {
-                sanisizer::resize(my_permutation, num_points);
-                std::iota(my_permutation.begin(), my_permutation.end(), static_cast<std::size_t>(0));
-                std::sort(my_permutation.begin(), my_permutation.end(), [&](std::size_t left, std::size_t right) -> bool { return x[left] < x[right]; });
+    void set(const std::size_t num_points, const Sortable_* const x, const int num_threads = 1) {
+        my_sorted = true;
+        my_num_points = num_points;
+        if (num_points == 0) {
+            return;
+        }
+
+        // Checking that all indices fit into Index_.
+        sanisizer::cast<Index_>(num_points);
+
+        const bool few_runs = internal::find_sorted_runs(num_points, x, internal::sort_max_merge_runs, my_run_starts, my_chunk_offsets, num_threads);
+        if (few_runs && my_run_starts.size() == 2) {
+            return;
+        }
+
+        my_sorted = false;
+        sanisizer::resize(my_permutation, num_points);
+
+        if (few_runs) {
+            std::iota(my_permutation.begin(), my_permutation.end(), static_cast<Index_>(0));
+            internal::merge_sorted_runs(x, my_run_starts, my_permutation, my_buffer, num_threads);
+            return;
+        }
+
+        if constexpr(internal::is_radix_sortable<Sortable_>()) {
+            if (num_points >= internal::sort_min_radix_size) {
+                typedef internal::RadixKey<Sortable_> Key;
+                auto& radix = radix_buffers<Key>();
+                auto& keys = radix.keys;
+                sanisizer::resize(keys, num_points);
+                parallelize(num_threads, num_points, [&](const int, const std::size_t start, const std::size_t length) {
+                    for (auto i = start, end = start + length; i < end; ++i) {
+                        keys[i] = internal::to_radix_key(x[i]);
+                        my_permutation[i] = i;
+                    }
+                });
+
+                internal::radix_sort(num_points, keys, my_permutation, radix.key_buffer, my_buffer, radix.varying, my_bucket_offsets, num_threads);
+                return;
             }
         }
+
+        std::iota(my_permutation.begin(), my_permutation.end(), static_cast<Index_>(0));
+        std::sort(my_permutation.begin(), my_permutation.end(), [&](const Index_ left, const Index_ right) -> bool { return x[left] < x[right]; });
     }
 
 private:
@@ -186,7 +507,66 @@ public:
         permute(data, work.data());
     }
 
+public:
+    /**
+     * Out-of-place alternative to `permute()`, where the permuted values are gathered from `input` into `output`.
+     * This is faster than the in-place permutation as each thread gathers a contiguous range of `output` in parallel,
+     * at the cost of requiring a separate buffer for the output.
+     *
+     * @tparam Data_ Any copyable data type.
+     * @param[in] input Pointer to an array of length `num_points`, to be permuted in the same manner that `x` (from the constructor) would be permuted for sorting.
+     * @param[out] output Pointer to an array of length `num_points`.
+     * On output, this contains the permuted contents of `input`.
+     * This should not overlap with `input`.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Data_>
+    void permute_into(const Data_* const input, Data_* const output, const int num_threads = 1) const {
+        if (my_sorted) {
+            copy_into(input, output, num_threads);
+            return;
+        }
+        parallelize(num_threads, my_num_points, [&](const int, const std::size_t start, const std::size_t length) {
+            const auto perm = my_permutation.data();
+            for (auto i = start, end = start + length; i < end; ++i) {
+                output[i] = input[perm[i]];
+            }
+        });
+    }
+
+    /**
+     * Out-of-place alternative to `unpermute()`, where the values in `input` are scattered into their original positions in `output`.
+     * Each thread processes a contiguous range of `input` in parallel.
+     *
+     * @tparam Data_ Any copyable data type.
+     * @param[in] input Pointer to an array of length `num_points`, typically containing results computed from the permuted data.
+     * @param[out] output Pointer to an array of length `num_points`.
+     * On output, this contains the contents of `input` in the original (pre-sort) order, reversing the effect of `permute_into()`.
+     * This should not overlap with `input`.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Data_>
+    void unpermute_into(const Data_* const input, Data_* const output, const int num_threads = 1) const {
+        if (my_sorted) {
+            copy_into(input, output, num_threads);
+            return;
+        }
+        parallelize(num_threads, my_num_points, [&](const int, const std::size_t start, const std::size_t length) {
+            const auto perm = my_permutation.data();
+            for (auto i = start, end = start + length; i < end; ++i) {
+                output[perm[i]] = input[i];
+            }
+        });
+    }
+
 private:
+    template<typename Data_>
+    void copy_into(const Data_* const input, Data_* const output, const int num_threads) const {
+        parallelize(num_threads, my_num_points, [&](const int, const std::size_t start, const std::size_t length) {
+            std::copy_n(input + start, length, output + start);
+        });
+    }
+
     template<typename AllData_, typename Used_>
     void unpermute_raw(AllData_& data, Used_* const work) const {
         if (my_sorted) {
@@ -297,6 +677,29 @@ public:
     }
 };
 
+/**
+ * @brief Utility class for sorting on a covariate with `std::size_t` indices.
+ *
+ * This is a `BasicSortBy` with `std::size_t` permutation indices, retained for back-compatibility.
+ */
+class SortBy : public BasicSortBy<std::size_t> {
+public:
+    /**
+     * @tparam Sortable_ Sortable type.
+     * @param num_points Number of points.
+     * @param[in] x Pointer to an array of sortable values, typically x-coordinates for the dataset.
+     * @param num_threads Number of threads to use.
+     */
+    template<typename Sortable_>
+    SortBy(const std::size_t num_points, const Sortable_* const x, const int num_threads = 1) : BasicSortBy<std::size_t>(num_points, x, num_threads) {}
+
+    /**
+     * Default constructor.
+     * The object should not be used until `set()` is called.
+     */
+    SortBy() = default;
+};
+
 }
 
 #endif
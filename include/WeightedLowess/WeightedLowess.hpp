@@ -2,9 +2,13 @@
 #define WEIGHTEDLOWESS_WEIGHTEDLOWESS_HPP
 
 #include "compute.hpp"
+#include "compute_unsorted.hpp"
+#include "batch.hpp"
+#include "operator.hpp"
 #include "interpolate.hpp"
 #include "SortBy.hpp"
 #include "Options.hpp"
+#include "Workspace.hpp"
 
 /**
  * @file WeightedLowess.hpp
@@ -0,0 +1,68 @@
+#ifndef WEIGHTEDLOWESS_WORKSPACE_HPP
+#define WEIGHTEDLOWESS_WORKSPACE_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "window.hpp"
+#include "SortBy.hpp"
+
+/**
+ * @file Workspace.hpp
+ *
+ * @brief Reusable scratch space for `compute()` and friends.
+ */
+
+namespace WeightedLowess {
+
+/**
+ * @brief Reusable scratch space for `compute()`, `compute_unsorted()` and `define_windows()`.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ *
+ * Each call to `compute()` or `define_windows()` needs some temporary buffers, e.g., for the absolute deviations in the robustness iterations.
+ * By default, these are allocated afresh in each call, which can be wasteful when many small smooths are performed in succession.
+ * Instead, users can create a `Workspace` instance and pass it to the relevant overloads of `compute()`, `compute_unsorted()` and `define_windows()`.
+ * The capacity of all buffers persists across calls and only grows when a larger dataset is encountered,
+ * so that repeated calls with the same (or fewer) number of points will not perform any further heap allocations.
+ *
+ * A `Workspace` instance should not be used in multiple concurrent calls.
+ */
+template<typename Data_, typename Index_ = std::size_t>
+struct Workspace {
+    /**
+     * @cond
+     */
+    // For the robustness iterations in fit_trend().
+    std::vector<Data_> abs_dev, values;
+    std::vector<std::size_t> permutation;
+
+    // For incremental robustness iterations in fit_trend().
+    std::vector<Data_> previous_robust_weights;
+    std::vector<std::size_t> num_changed;
+    std::vector<unsigned char> affected;
+
+    // For partitioning the anchors between threads in fit_trend().
+    std::vector<std::size_t> partition;
+
+    // For the robustness weights when the caller doesn't want them.
+    std::vector<Data_> robust_weights;
+
+    // For define_windows().
+    internal::WindowBuffers<Data_, Index_> window_buffers;
+
+    // For the overloads of compute() that also define the windows.
+    PrecomputedWindows<Data_, Index_> windows;
+
+    // For compute_unsorted().
+    BasicSortBy<Index_> sorter;
+    std::vector<Data_> sorted_x, sorted_y, sorted_weights, sorted_fitted, sorted_robust_weights;
+    /**
+     * @endcond
+     */
+};
+
+}
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef WEIGHTEDLOWESS_BATCH_HPP
+#define WEIGHTEDLOWESS_BATCH_HPP
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+#include <stdexcept>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "fit.hpp"
+#include "window.hpp"
+#include "Workspace.hpp"
+#include "Options.hpp"
+#include "parallelize.hpp"
+#include "utils.hpp"
+
+/**
+ * @file batch.hpp
+ * @brief Compute LOWESS trend fits for multiple y-vectors.
+ */
+
+namespace WeightedLowess {
+
+/**
+ * @cond
+ */
+namespace internal {
+
+/* 
+ * Number of y-vectors to process at once in fit_point_batch().
+ * This should be small enough that all accumulators fit in registers.
+ */
+constexpr std::size_t batch_block_size = 8;
+
+template<typename Data_, typename Index_>
+struct BatchWorkspace {
+    Workspace<Data_, Index_> fit;
+    std::vector<Data_> y, fitted, robust_weights;
+};
+
+/*
+ * Allocating all buffers that are used by fit_block() and fit_trend() at
+ * their maximum sizes. This is done for each thread's workspace before the
+ * parallel section, as parallelize() assumes that no allocations (and thus no
+ * exceptions) occur inside it. All subsequent resizing is then a no-op.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+void prepare_batch_workspace(
+    BatchWorkspace<Data_, Index_>& work,
+    const std::size_t num_points,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const bool row_major,
+    const Options<Data_, Accumulate_>& opt)
+{
+    if (row_major) {
+        const auto block_points = sanisizer::product<std::size_t>(num_points, batch_block_size);
+        sanisizer::resize(work.y, block_points);
+        sanisizer::resize(work.fitted, block_points);
+        sanisizer::resize(work.robust_weights, block_points);
+    } else {
+        sanisizer::resize(work.robust_weights, num_points);
+    }
+
+    auto& fit = work.fit;
+    partition_anchors(windows, opt.num_threads, fit.partition);
+    if (opt.iterations == 0) {
+        return;
+    }
+
+    sanisizer::resize(fit.abs_dev, num_points);
+    if (windows.freq_weights != NULL) {
+        sanisizer::resize(fit.permutation, num_points);
+    } else {
+        sanisizer::resize(fit.values, num_points);
+    }
+
+    if (opt.incremental_threshold.has_value() || opt.convergence_tolerance.has_value()) {
+        sanisizer::resize(fit.previous_robust_weights, num_points);
+    }
+    if (opt.incremental_threshold.has_value()) {
+        sanisizer::resize(fit.num_changed, sanisizer::sum<std::size_t>(num_points, 1));
+        sanisizer::resize(fit.affected, windows.anchors.size());
+    }
+}
+
+template<typename Data_, typename Index_, typename Accumulate_>
+int fit_block(
+    const std::size_t num_points,
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const std::size_t num_columns,
+    const std::size_t column_start,
+    const std::size_t column_count,
+    const Data_* const y,
+    const bool row_major,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt,
+    BatchWorkspace<Data_, Index_>& work
+) {
+    assert(column_count > 0 && column_count <= batch_block_size);
+    std::array<const Data_*, batch_block_size> yptrs;
+    std::array<Data_*, batch_block_size> fptrs, rptrs;
+
+    if (!row_major) {
+        for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+            const auto offset = sanisizer::product_unsafe<std::size_t>(column_start + b, num_points);
+            yptrs[b] = y + offset;
+            fptrs[b] = fitted + offset;
+        }
+        if (robust_weights != NULL) {
+            for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+                rptrs[b] = robust_weights + sanisizer::product_unsafe<std::size_t>(column_start + b, num_points);
+            }
+        } else {
+            sanisizer::resize(work.robust_weights, num_points);
+            rptrs.fill(work.robust_weights.data());
+        }
+
+    } else {
+        // For row-major inputs, we gather each column into a contiguous buffer
+        // so that the memory access pattern in fit_trend() is unchanged.
+        const auto block_points = sanisizer::product<std::size_t>(num_points, column_count);
+        sanisizer::resize(work.y, block_points);
+        sanisizer::resize(work.fitted, block_points);
+        sanisizer::resize(work.robust_weights, block_points);
+        for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+            const auto offset = sanisizer::product_unsafe<std::size_t>(b, num_points);
+            yptrs[b] = work.y.data() + offset;
+            fptrs[b] = work.fitted.data() + offset;
+            rptrs[b] = work.robust_weights.data() + offset;
+        }
+
+        for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
+            const auto yrow = y + sanisizer::product_unsafe<std::size_t>(i, num_columns) + column_start;
+            for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+                work.y[sanisizer::product_unsafe<std::size_t>(b, num_points) + i] = yrow[b];
+            }
+        }
+    }
+
+    // Padding the block so that fit_point_batch() can always use the fully unrolled kernel.
+    for (auto b = column_count; b < batch_block_size; ++b) {
+        yptrs[b] = yptrs[0];
+    }
+
+    const auto& anchors = windows.anchors;
+    const auto& limits = windows.limits;
+    partition_anchors(windows, opt.num_threads, work.fit.partition);
+    parallelize_partition(opt.num_threads, work.fit.partition, [&](const std::size_t start, const std::size_t end) {
+        for (auto s = start; s < end; ++s) {
+            fit_point_batch<Accumulate_>(anchors[s], limits[s], x, yptrs, column_count, opt.weights, fptrs.data());
+        }
+    });
+
+    int iterations = 0;
+    for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+        const auto it = fit_trend(num_points, x, windows, yptrs[b], fptrs[b], rptrs[b], opt, work.fit, /* prefitted = */ true);
+        iterations = std::max(iterations, it);
+    }
+
+    if (row_major) {
+        for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
+            const auto offset = sanisizer::product_unsafe<std::size_t>(i, num_columns) + column_start;
+            for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+                fitted[offset + b] = fptrs[b][i];
+            }
+            if (robust_weights != NULL) {
+                for (I<decltype(column_count)> b = 0; b < column_count; ++b) {
+                    robust_weights[offset + b] = rptrs[b][i];
+                }
+            }
+        }
+    }
+
+    return iterations;
+}
+
+template<typename Data_, typename Index_, typename Accumulate_>
+int fit_columns(
+    const std::size_t num_points,
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const std::size_t num_columns,
+    const std::size_t column_start,
+    const std::size_t column_end,
+    const Data_* const y,
+    const bool row_major,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt,
+    BatchWorkspace<Data_, Index_>& work
+) {
+    int iterations = 0;
+    for (auto c = column_start; c < column_end; c += batch_block_size) {
+        const auto count = std::min(column_end - c, batch_block_size);
+        const auto it = fit_block(num_points, x, windows, num_columns, c, count, y, row_major, fitted, robust_weights, opt, work);
+        iterations = std::max(iterations, it);
+    }
+    return iterations;
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Run the LOWESS algorithm on multiple y-vectors that share the same x-coordinates, e.g., for smoothing many features against a common covariate.
+ * This is equivalent to calling `compute()` on each column of the matrix `y`, but is more efficient as the windows are only computed once and all scratch buffers are re-used across columns.
+ * Columns are also processed in small blocks for the first (non-robust) fit, where the tricube weights for each window are computed once and shared by all columns in the block.
+ *
+ * If the number of columns is greater than or equal to `Options::num_threads`, parallelization is performed across columns.
+ * Otherwise, each column is processed in turn, and parallelization is performed across anchors within each call to `compute()`.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * @param windows Precomputed windows around the anchor points, created by calling `define_windows()` with `num_points`, `x` and `opt`.
+ * @param num_columns Number of y-vectors, i.e., columns of `y`.
+ * @param[in] y Pointer to an array of length equal to the product of `num_points` and `num_columns`,
+ * containing a matrix of y-coordinates where each row is a point and each column is a y-vector.
+ * @param row_major Whether `y` (and `fitted` and `robust_weights`) are stored in row-major format.
+ * If `false`, they are assumed to be column-major.
+ * @param[out] fitted Pointer to an output array of length equal to the product of `num_points` and `num_columns`,
+ * in which the fitted values for each y-vector can be stored in the same layout as `y`.
+ * @param[out] robust_weights Pointer to an output array of length equal to the product of `num_points` and `num_columns`,
+ * in which the robustness weights for each y-vector can be stored in the same layout as `y`.
+ * This may be `NULL` if the robustness weights are not needed.
+ * @param opt Further options.
+ * This should be the same object that is used in `define_windows()`.
+ * Warm starts are not supported as the first fit is shared across columns.
+ *
+ * @return Maximum number of robustness iterations that were performed for any y-vector.
+ * This is equal to `Options::iterations` unless the iterations were terminated early for all y-vectors, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+int compute_batch(
+    const std::size_t num_points,
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const std::size_t num_columns,
+    const Data_* const y,
+    const bool row_major,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt
+) {
+    if (opt.warm_start != WarmStart::NONE) {
+        throw std::runtime_error("warm starts are not supported in 'compute_batch()'");
+    }
+    if (num_points == 0 || num_columns == 0) {
+        return 0;
+    }
+
+    if (num_columns < static_cast<std::size_t>(opt.num_threads)) {
+        internal::BatchWorkspace<Data_, Index_> work;
+        return internal::fit_columns(num_points, x, windows, num_columns, 0, num_columns, y, row_major, fitted, robust_weights, opt, work);
+    }
+
+    auto copt = opt;
+    copt.num_threads = 1;
+    auto works = sanisizer::create<std::vector<internal::BatchWorkspace<Data_, Index_> > >(opt.num_threads);
+    for (auto& work : works) {
+        internal::prepare_batch_workspace(work, num_points, windows, row_major, copt);
+    }
+    auto iterations = sanisizer::create<std::vector<int> >(opt.num_threads);
+
+    parallelize(opt.num_threads, num_columns, [&](const int t, const I<decltype(num_columns)> start, const I<decltype(num_columns)> length) {
+        iterations[t] = internal::fit_columns(num_points, x, windows, num_columns, start, start + length, y, row_major, fitted, robust_weights, copt, works[t]);
+    });
+
+    return *std::max_element(iterations.begin(), iterations.end());
+}
+
+}
+
+#endif
@@ -3,10 +3,13 @@
 
 #include <vector>
 #include <cstddef>
+#include <stdexcept>
 
 #include "sanisizer/sanisizer.hpp"
 
 #include "fit.hpp"
+#include "window.hpp"
+#include "Workspace.hpp"
 #include "Options.hpp"
 #include "utils.hpp"
 
@@ -28,6 +31,8 @@ namespace WeightedLowess {
  * the regressions are then repeated with robustness weights for the specified number of iterations.
  *
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
  *
  * @param num_points Number of points.
  * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
@@ -36,35 +41,86 @@ namespace WeightedLowess {
  * @param windows Precomputed windows around the anchor points, created by calling `define_windows()` with `num_points`, `x` and `opt`.
  * This can be re-used across multiple calls to `compute()` with different `y`.
  * @param[in] y Pointer to an array of `num_points` y-coordinates. 
- * @param[out] fitted Pointer to an output array of length `num_points`, in which the fitted values of the smoother can be stored.
- * @param[out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
+ * @param[in,out] fitted Pointer to an output array of length `num_points`, in which the fitted values of the smoother can be stored.
+ * If `Options::warm_start = WarmStart::FITTED`, this should contain the fitted values from a previous call on input.
+ * @param[in,out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
  * This may be `NULL` if the robustness weights are not needed.
+ * If `Options::warm_start = WarmStart::ROBUST_WEIGHTS`, this should be non-`NULL` and contain the robustness weights from a previous call on input.
  * @param opt Further options.
  * This should be the same object that is used in `define_windows()`.
- * Note that only a subset of options are actually used in this overload, namely `Options::weights` and `Options::iterations`.
+ * Note that only a subset of options are actually used in this overload, namely
+ * `Options::weights`,
+ * `Options::iterations`,
+ * `Options::convergence_tolerance`,
+ * `Options::incremental_threshold`,
+ * `Options::fast_sums`,
+ * `Options::warm_start`
+ * and `Options::num_threads`.
+ *
+ * @return Number of robustness iterations that were performed.
+ * This is equal to `Options::iterations` unless the iterations were terminated early, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
  */
-template<typename Data_>
-void compute(
+template<typename Data_, typename Index_, typename Accumulate_>
+int compute(
+    const std::size_t num_points,
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const Data_* const y,
+    Data_* const fitted,
+    Data_* robust_weights,
+    const Options<Data_, Accumulate_>& opt
+) {
+    Workspace<Data_, Index_> work;
+    return compute(num_points, x, windows, y, fitted, robust_weights, opt, work);
+}
+
+/**
+ * Overload of `compute()` that re-uses memory from previous calls via a `Workspace`.
+ * Once the workspace's buffers are large enough, repeated calls with the same (or fewer) number of points will not perform any heap allocations.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * @param windows Precomputed windows around the anchor points, created by calling `define_windows()` with `num_points`, `x` and `opt`.
+ * @param[in] y Pointer to an array of `num_points` y-coordinates. 
+ * @param[out] fitted Pointer to an output array of length `num_points`, in which the fitted values of the smoother can be stored.
+ * @param[out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
+ * This may be `NULL` if the robustness weights are not needed.
+ * @param opt Further options, see the other overloads of `compute()` for details.
+ * @param work Workspace for temporary buffers.
+ *
+ * @return Number of robustness iterations that were performed.
+ * This is equal to `Options::iterations` unless the iterations were terminated early, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+int compute(
     const std::size_t num_points,
     const Data_* const x,
-    const PrecomputedWindows<Data_>& windows,
+    const PrecomputedWindows<Data_, Index_>& windows,
     const Data_* const y,
     Data_* const fitted,
     Data_* robust_weights,
-    const Options<Data_>& opt
+    const Options<Data_, Accumulate_>& opt,
+    Workspace<Data_, Index_>& work
 ) {
-    std::vector<Data_> rbuffer;
     if (robust_weights == NULL) {
-        sanisizer::resize(rbuffer, num_points);
-        robust_weights = rbuffer.data();
+        if (opt.warm_start == WarmStart::ROBUST_WEIGHTS) {
+            throw std::runtime_error("'robust_weights' should be supplied for a warm start from robustness weights");
+        }
+        sanisizer::resize(work.robust_weights, num_points);
+        robust_weights = work.robust_weights.data();
     }
-    internal::fit_trend(num_points, x, windows, y, fitted, robust_weights, opt);
+    return internal::fit_trend(num_points, x, windows, y, fitted, robust_weights, opt, work);
 }
 
 /**
  * Overload of `compute()` that computes the windows around each anchor point.
  *
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
  *
  * @param num_points Number of points.
  * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
@@ -75,18 +131,55 @@ void compute(
  * @param[out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
  * This may be `NULL` if the robustness weights are not needed.
  * @param opt Further options.
+ *
+ * @return Number of robustness iterations that were performed.
+ * This is equal to `Options::iterations` unless the iterations were terminated early, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
  */
-template<typename Data_>
-void compute(
+template<typename Data_, typename Accumulate_>
+int compute(
+    const std::size_t num_points,
+    const Data_* const x,
+    const Data_* const y,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt
+) {
+    Workspace<Data_> work;
+    return compute(num_points, x, y, fitted, robust_weights, opt, work);
+}
+
+/**
+ * Overload of `compute()` that computes the windows around each anchor point, re-using memory from previous calls via a `Workspace`.
+ * The windows are stored inside `work` so that no heap allocations are required once its buffers are large enough.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * @param[in] y Pointer to an array of `num_points` y-coordinates.
+ * @param[out] fitted Pointer to an output array of length `num_points`, in which the fitted values of the smoother can be stored.
+ * @param[out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
+ * This may be `NULL` if the robustness weights are not needed.
+ * @param opt Further options.
+ * @param work Workspace for temporary buffers.
+ *
+ * @return Number of robustness iterations that were performed.
+ * This is equal to `Options::iterations` unless the iterations were terminated early, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+int compute(
     const std::size_t num_points,
     const Data_* const x,
     const Data_* const y,
     Data_* const fitted,
     Data_* const robust_weights,
-    const Options<Data_>& opt
+    const Options<Data_, Accumulate_>& opt,
+    Workspace<Data_, Index_>& work
 ) {
-    const auto win = define_windows(num_points, x, opt);
-    compute(num_points, x, win, y, fitted, robust_weights, opt);
+    define_windows(num_points, x, opt, work.windows, work);
+    return compute(num_points, x, work.windows, y, fitted, robust_weights, opt, work);
 }
 
 /** 
@@ -114,12 +207,19 @@ struct Results {
      * Robustness weight for each point.
      */
     std::vector<Data_> robust_weights;
+
+    /**
+     * Number of robustness iterations that were performed.
+     * This may be less than `Options::iterations` if the iterations were terminated early, e.g., upon convergence.
+     */
+    int iterations = 0;
 };
 
 /**
  * Overload of `compute()` that allocates storage for the results of the smoothing.
  * 
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
  *
  * @param num_points Number of points.
  * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
@@ -127,21 +227,62 @@ struct Results {
  * Note that the same permutation should be applied to `y` and, if present, weights in `Options::weights`.)
  * @param[in] y Pointer to an array of `num_points` y-coordinates.
  * @param opt Further options.
+ * Warm starts are not supported as there are no existing results, see the other `Results` overload instead.
  *
  * @return A `Results` object containing the fitted values and robustness weights.
  */
-template<typename Data_>
+template<typename Data_, typename Accumulate_>
 Results<Data_> compute(
     const std::size_t num_points,
     const Data_* const x,
     const Data_* const y,
-    const Options<Data_>& opt
+    const Options<Data_, Accumulate_>& opt
 ) {
+    if (opt.warm_start != WarmStart::NONE) {
+        throw std::runtime_error("warm starts require existing results");
+    }
     Results<Data_> output(num_points);
-    compute(num_points, x, y, output.fitted.data(), output.robust_weights.data(), opt);
+    output.iterations = compute(num_points, x, y, output.fitted.data(), output.robust_weights.data(), opt);
     return output;
 }
 
+/**
+ * Overload of `compute()` that stores the results in an existing `Results` object, re-using memory from previous calls.
+ * 
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * @param[in] y Pointer to an array of `num_points` y-coordinates.
+ * @param opt Further options.
+ * @param[in,out] results Results of the smoothing.
+ * On output, the vectors are resized to `num_points` and filled with the fitted values and robustness weights,
+ * and the number of robustness iterations is stored in `Results::iterations`.
+ * If `Options::warm_start` is set, this should contain the results of a previous call with `num_points` points on input,
+ * e.g., to perform more robustness iterations on an existing fit.
+ * @param work Workspace for temporary buffers.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+void compute(
+    const std::size_t num_points,
+    const Data_* const x,
+    const Data_* const y,
+    const Options<Data_, Accumulate_>& opt,
+    Results<Data_>& results,
+    Workspace<Data_, Index_>& work
+) {
+    if (opt.warm_start != WarmStart::NONE) {
+        if (results.fitted.size() != num_points || results.robust_weights.size() != num_points) {
+            throw std::runtime_error("existing results should have length equal to the number of points for a warm start");
+        }
+    }
+    sanisizer::resize(results.fitted, num_points);
+    sanisizer::resize(results.robust_weights, num_points);
+    results.iterations = compute(num_points, x, y, results.fitted.data(), results.robust_weights.data(), opt, work);
+}
+
 }
 
 #endif
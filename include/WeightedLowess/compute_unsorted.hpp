@@ -0,0 +1,162 @@
+#ifndef WEIGHTEDLOWESS_COMPUTE_UNSORTED_HPP
+#define WEIGHTEDLOWESS_COMPUTE_UNSORTED_HPP
+
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "compute.hpp"
+#include "window.hpp"
+#include "Workspace.hpp"
+#include "Options.hpp"
+
+/**
+ * @file compute_unsorted.hpp
+ * @brief Compute the LOWESS trend fit for unsorted x-coordinates.
+ */
+
+namespace WeightedLowess {
+
+/**
+ * Run the LOWESS algorithm on x-coordinates that are not necessarily sorted.
+ * This is equivalent to using `SortBy` to permute `x`, `y` and `Options::weights`, calling `compute()`, and unpermuting the fitted values and robustness weights;
+ * except that the input arrays are never modified, and the sorted copies are gathered into scratch buffers in `work` instead.
+ * The results are then scattered back into `fitted` and `robust_weights` in the original order of the points.
+ * If `x` is already sorted, `compute()` is called directly without any copies.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, in any order.
+ * @param[in] y Pointer to an array of `num_points` y-coordinates.
+ * @param[in,out] fitted Pointer to an output array of length `num_points`, in which the fitted values of the smoother can be stored.
+ * On output, the fitted value for each point is stored in the same position as that point in `x` and `y`.
+ * For warm starts, this should contain existing fitted values on input, see `compute()` for details.
+ * @param[in,out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
+ * This may be `NULL` if the robustness weights are not needed.
+ * For warm starts, this should contain existing robustness weights on input, see `compute()` for details.
+ * @param opt Further options.
+ * If `Options::weights` is supplied, it should be in the same order as `x`.
+ * @param work Workspace for temporary buffers.
+ *
+ * @return Number of robustness iterations that were performed.
+ * This is equal to `Options::iterations` unless the iterations were terminated early, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+int compute_unsorted(
+    const std::size_t num_points,
+    const Data_* const x,
+    const Data_* const y,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt,
+    Workspace<Data_, Index_>& work
+) {
+    if (internal::parallel_is_sorted(num_points, x, opt.num_threads, work.window_buffers.chunk_flags)) {
+        return compute(num_points, x, y, fitted, robust_weights, opt, work);
+    }
+
+    auto& sorter = work.sorter;
+    sorter.set(num_points, x, opt.num_threads);
+
+    sanisizer::resize(work.sorted_x, num_points);
+    sorter.permute_into(x, work.sorted_x.data(), opt.num_threads);
+    sanisizer::resize(work.sorted_y, num_points);
+    sorter.permute_into(y, work.sorted_y.data(), opt.num_threads);
+
+    auto sopt = opt;
+    if (opt.weights != NULL) {
+        sanisizer::resize(work.sorted_weights, num_points);
+        sorter.permute_into(opt.weights, work.sorted_weights.data(), opt.num_threads);
+        sopt.weights = work.sorted_weights.data();
+    }
+
+    sanisizer::resize(work.sorted_fitted, num_points);
+    if (opt.warm_start == WarmStart::FITTED) {
+        sorter.permute_into(fitted, work.sorted_fitted.data(), opt.num_threads);
+    }
+
+    Data_* sorted_robust_weights = NULL;
+    if (robust_weights != NULL) {
+        sanisizer::resize(work.sorted_robust_weights, num_points);
+        sorted_robust_weights = work.sorted_robust_weights.data();
+        if (opt.warm_start == WarmStart::ROBUST_WEIGHTS) {
+            sorter.permute_into(robust_weights, sorted_robust_weights, opt.num_threads);
+        }
+    }
+
+    const auto iterations = compute(num_points, work.sorted_x.data(), work.sorted_y.data(), work.sorted_fitted.data(), sorted_robust_weights, sopt, work);
+
+    sorter.unpermute_into(work.sorted_fitted.data(), fitted, opt.num_threads);
+    if (robust_weights != NULL) {
+        sorter.unpermute_into(sorted_robust_weights, robust_weights, opt.num_threads);
+    }
+    return iterations;
+}
+
+/**
+ * Overload of `compute_unsorted()` that allocates a new workspace.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, in any order.
+ * @param[in] y Pointer to an array of `num_points` y-coordinates.
+ * @param[out] fitted Pointer to an output array of length `num_points`, in which the fitted values of the smoother can be stored.
+ * @param[out] robust_weights Pointer to an output array of length `num_points`, in which the robustness weights can be stored.
+ * This may be `NULL` if the robustness weights are not needed.
+ * @param opt Further options.
+ *
+ * @return Number of robustness iterations that were performed.
+ * This is equal to `Options::iterations` unless the iterations were terminated early, see `Options::convergence_tolerance` and `Options::incremental_threshold`.
+ */
+template<typename Data_, typename Accumulate_>
+int compute_unsorted(
+    const std::size_t num_points,
+    const Data_* const x,
+    const Data_* const y,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt
+) {
+    Workspace<Data_> work;
+    return compute_unsorted(num_points, x, y, fitted, robust_weights, opt, work);
+}
+
+/**
+ * Overload of `compute_unsorted()` that allocates storage for the results of the smoothing.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, in any order.
+ * @param[in] y Pointer to an array of `num_points` y-coordinates.
+ * @param opt Further options.
+ * Warm starts are not supported as there are no existing results.
+ *
+ * @return A `Results` object containing the fitted values and robustness weights, in the original order of the points.
+ */
+template<typename Data_, typename Accumulate_>
+Results<Data_> compute_unsorted(
+    const std::size_t num_points,
+    const Data_* const x,
+    const Data_* const y,
+    const Options<Data_, Accumulate_>& opt
+) {
+    if (opt.warm_start != WarmStart::NONE) {
+        throw std::runtime_error("warm starts require existing results");
+    }
+    Results<Data_> output(num_points);
+    output.iterations = compute_unsorted(num_points, x, y, output.fitted.data(), output.robust_weights.data(), opt);
+    return output;
+}
+
+}
+
+#endif
@@ -2,58 +2,305 @@
 #define WEIGHTEDLOWESS_FIT_HPP
 
 #include <vector>
+#include <array>
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cassert>
+#include <limits>
+#include <type_traits>
+#include <utility>
 
 #include "subpar/subpar.hpp"
 #include "sanisizer/sanisizer.hpp"
 
 #include "window.hpp"
+#include "Workspace.hpp"
 #include "Options.hpp"
 #include "robust.hpp"
 #include "parallelize.hpp"
+#include "utils.hpp"
 
 namespace WeightedLowess {
 
 namespace internal {
 
+/*
+ * Number of independent accumulators for each moment in the window regression.
+ * The inner loops over the lanes are branch-free with a fixed trip count, so
+ * compilers can map them onto SIMD registers (e.g., 2 x AVX2 or 1 x AVX-512
+ * for doubles, or NEON) without needing to reorder the floating-point sums.
+ * Any remaining points at the end of each window are processed by a scalar loop.
+ */
+constexpr std::size_t simd_lanes = 8;
+
+template<typename Data_>
+Data_ reduce_lanes(const std::array<Data_, simd_lanes>& lanes) {
+    Data_ output = 0;
+    for (std::size_t l = 0; l < simd_lanes; ++l) {
+        output += lanes[l];
+    }
+    return output;
+}
+
+/*
+ * Weighted moments for the local linear regression. All x-coordinates are
+ * centered at the anchor, so the fitted value is just the intercept. This
+ * allows us to accumulate all moments in a single pass over the window, as
+ * the shifted x-coordinates are small (i.e., bounded by the window distance)
+ * and the usual cancellation problems of the one-pass variance formula are
+ * mostly avoided. They are not avoided entirely, e.g., if the anchor and its
+ * ties have zero robustness weight, the weighted mean of the remaining
+ * x-coordinates may be far from the anchor relative to their spread; so
+ * solve_moments() calls a 'fallback' to perform a second, centered pass
+ * over the window whenever the one-pass variance is not trustworthy.
+ */
+template<typename Data_>
+struct Moments {
+    Data_ sumw = 0, sumwx = 0, sumwxx = 0, sumwy = 0, sumwxy = 0;
+};
+
+/*
+ * Relative tolerance for the one-pass variance in solve_moments(), below which
+ * we consider it to be untrustworthy due to rounding error.
+ */
 template<typename Data_>
-Data_ cube(Data_ x) {
-    return x * x * x;
+Data_ moment_tolerance() {
+    return std::numeric_limits<Data_>::epsilon() * 8;
+}
+
+template<typename Data_, class Fallback_>
+Data_ solve_moments(
+    const Data_ sumw,
+    const Data_ sumwx,
+    const Data_ sumwxx,
+    const Data_ sumwy,
+    const Data_ sumwxy,
+    Fallback_ fallback,
+    const Data_ tolerance = moment_tolerance<Data_>())
+{
+    const Data_ xmean = sumwx / sumw;
+    const Data_ var = sumwxx - xmean * sumwx;
+
+    // Rounding error in the one-pass formula means that a zero variance is
+    // not guaranteed to be exactly computed as zero, and a small non-zero
+    // variance may be lost to cancellation. In both cases, we defer to the
+    // fallback, which recomputes the moments around the weighted mean.
+    if (var <= sumwxx * tolerance) {
+        return fallback();
+    } else {
+        const Data_ ymean = sumwy / sumw;
+        const Data_ covar = sumwxy - xmean * sumwy;
+        const Data_ slope = covar / var;
+        return ymean - slope * xmean;
+    }
+}
+
+template<typename Data_, class Fallback_>
+Data_ solve_moments(const Moments<Data_>& mom, Fallback_ fallback, const Data_ tolerance = moment_tolerance<Data_>()) {
+    return solve_moments(mom.sumw, mom.sumwx, mom.sumwxx, mom.sumwy, mom.sumwxy, std::move(fallback), tolerance);
+}
+
+/*
+ * Checking whether the variance from a centered second pass is zero. The
+ * weighted mean of the x-coordinates is not exactly computed, so each centered
+ * x-coordinate has an absolute rounding error of up to a few epsilons of the
+ * window distance. Any variance below the corresponding floor is
+ * indistinguishable from zero, e.g., when only one point has non-zero weight;
+ * treating it as non-zero would give a slope that is a ratio of rounding errors.
+ */
+template<typename Data_>
+bool is_centered_variance_zero(const Data_ var, const Data_ sumw, const Data_ dist) {
+    const Data_ scale = dist * moment_tolerance<Data_>();
+    return var <= sumw * scale * scale;
+}
+
+/*
+ * Second pass over the window with the x- and y-coordinates centered at their
+ * weighted means (from 'mom', which must be computed with the same weights).
+ * This is the classic two-pass regression, which is robust to cancellation
+ * but requires the tricube weights to be computed twice; hence, we only use
+ * it as a fallback for solve_moments(). As before, the x-coordinates are
+ * relative to the anchor so the fitted value is the intercept. Still
+ * possible for var = 0 if all other points have zero weight, in which case
+ * we return the weighted mean of the y-values.
+ */
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_, typename Index_>
+Accumulate_ solve_centered(
+    const Window<Data_, Index_>& limits,
+    const Accumulate_ curx,
+    const Data_* const x,
+    const Data_* const y,
+    const Data_* const weights,
+    const Data_* const robust_weights,
+    const Moments<Accumulate_>& mom)
+{
+    const Accumulate_ dist = limits.distance;
+    const Accumulate_ xmean = mom.sumwx / mom.sumw;
+    const Accumulate_ ymean = mom.sumwy / mom.sumw;
+
+    Accumulate_ var = 0, covar = 0;
+    for (auto pt = limits.left; pt <= limits.right; ++pt) {
+        const Accumulate_ dx = static_cast<Accumulate_>(x[pt]) - curx;
+        Accumulate_ curw = tricube(dx, dist);
+        if constexpr(Robust_) {
+            curw *= robust_weights[pt];
+        }
+        if constexpr(Weighted_) {
+            curw *= weights[pt];
+        }
+        const Accumulate_ xdiff = dx - xmean;
+        const Accumulate_ cwdx = curw * xdiff;
+        var += cwdx * xdiff;
+        covar += cwdx * (static_cast<Accumulate_>(y[pt]) - ymean);
+    }
+
+    if (is_centered_variance_zero(var, mom.sumw, dist)) {
+        return ymean;
+    } else {
+        const Accumulate_ slope = covar / var;
+        return ymean - slope * xmean;
+    }
+}
+
+/*
+ * Computes the tricube weights for 'simd_lanes' consecutive points, folding in
+ * the robustness and prior weights. Checks for the presence of prior and
+ * robustness weights are hoisted out of the loop via the template parameters,
+ * so the unweighted, non-robust specialization only reads x.
+ */
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_>
+void compute_lane_weights(
+    const std::size_t start,
+    const Accumulate_ curx,
+    const Accumulate_ dist,
+    const Data_* const x,
+    const Data_* const weights,
+    const Data_* const robust_weights,
+    std::array<Accumulate_, simd_lanes>& current,
+    std::array<Accumulate_, simd_lanes>& wdx)
+{
+    for (std::size_t l = 0; l < simd_lanes; ++l) {
+        const auto pt = start + l;
+        const Accumulate_ dx = static_cast<Accumulate_>(x[pt]) - curx;
+        Accumulate_ curw = tricube(dx, dist);
+        if constexpr(Robust_) {
+            curw *= robust_weights[pt];
+        }
+        if constexpr(Weighted_) {
+            curw *= weights[pt];
+        }
+        current[l] = curw;
+        wdx[l] = curw * dx;
+    }
+}
+
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_, typename Index_>
+Moments<Accumulate_> accumulate_moments(
+    const Window<Data_, Index_>& limits,
+    const Accumulate_ curx,
+    const Data_* const x,
+    const Data_* const y,
+    const Data_* const weights,
+    const Data_* const robust_weights)
+{
+    const auto left = limits.left, end = limits.right + 1;
+    const Accumulate_ dist = limits.distance;
+
+    std::array<Accumulate_, simd_lanes> current, wdx, sumw, sumwx, sumwxx, sumwy, sumwxy;
+    sumw.fill(0);
+    sumwx.fill(0);
+    sumwxx.fill(0);
+    sumwy.fill(0);
+    sumwxy.fill(0);
+
+    auto pt = left;
+    for (; end - pt >= simd_lanes; pt += simd_lanes) {
+        compute_lane_weights<Weighted_, Robust_>(pt, curx, dist, x, weights, robust_weights, current, wdx);
+        for (std::size_t l = 0; l < simd_lanes; ++l) {
+            const Accumulate_ yval = y[pt + l];
+            sumw[l] += current[l];
+            sumwx[l] += wdx[l];
+            sumwxx[l] += wdx[l] * (x[pt + l] - curx);
+            sumwy[l] += current[l] * yval;
+            sumwxy[l] += wdx[l] * yval;
+        }
+    }
+
+    Moments<Accumulate_> output;
+    output.sumw = reduce_lanes(sumw);
+    output.sumwx = reduce_lanes(sumwx);
+    output.sumwxx = reduce_lanes(sumwxx);
+    output.sumwy = reduce_lanes(sumwy);
+    output.sumwxy = reduce_lanes(sumwxy);
+
+    // Scalar fallback for the remainder.
+    for (; pt < end; ++pt) {
+        const Accumulate_ dx = static_cast<Accumulate_>(x[pt]) - curx;
+        Accumulate_ curw = tricube(dx, dist);
+        if constexpr(Robust_) {
+            curw *= robust_weights[pt];
+        }
+        if constexpr(Weighted_) {
+            curw *= weights[pt];
+        }
+        const Accumulate_ cwdx = curw * dx;
+        const Accumulate_ yval = y[pt];
+        output.sumw += curw;
+        output.sumwx += cwdx;
+        output.sumwxx += cwdx * dx;
+        output.sumwy += curw * yval;
+        output.sumwxy += cwdx * yval;
+    }
+
+    return output;
 }
 
 /* 
  * Computes the lowess fit at a given point using linear regression with a
- * combination of tricube, prior and robustness weighting. 
+ * combination of tricube, prior and robustness weighting. If 'Robust_ = false',
+ * all robustness weights are assumed to be 1 and 'robust_weights' is ignored;
+ * this is used in the first iteration to avoid reading an array of ones.
+ *
+ * All sums are accumulated in 'Accumulate_', which may be more precise than
+ * the storage type 'Data_'.
  */
-template<typename Data_>
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_, typename Index_>
 Data_ fit_point (
     const std::size_t curpt,
-    const Window<Data_>& limits, 
+    const Window<Data_, Index_>& limits, 
     const Data_* const x,
     const Data_* const y,
     const Data_* const weights, 
-    const Data_* const robust_weights, 
-    std::vector<Data_>& work)
+    const Data_* const robust_weights)
 {
     const auto left = limits.left, right = limits.right;
-    const Data_ dist = limits.distance;
+    const Accumulate_ dist = limits.distance;
 
     if (dist <= 0) {
-        Data_ ymean = 0, allweight = 0;
+        Accumulate_ ymean = 0, allweight = 0;
         for (auto pt = left; pt <= right; ++pt) {
-            Data_ curweight = (weights != NULL ? robust_weights[pt] * weights[pt] : robust_weights[pt]);
-            ymean += y[pt] * curweight;
+            Accumulate_ curweight = 1;
+            if constexpr(Robust_) {
+                curweight = robust_weights[pt];
+            }
+            if constexpr(Weighted_) {
+                curweight *= weights[pt];
+            }
+            ymean += static_cast<Accumulate_>(y[pt]) * curweight;
             allweight += curweight;
         }
 
-        if (allweight == 0) { // ignore the robustness weights.
-            for (auto pt = left; pt <= right; ++pt) {
-                Data_ curweight = (weights != NULL ? weights[pt] : static_cast<Data_>(1));
-                ymean += y[pt] * curweight;
-                allweight += curweight;
+        if constexpr(Robust_) {
+            if (allweight == 0) { // ignore the robustness weights.
+                for (auto pt = left; pt <= right; ++pt) {
+                    Accumulate_ curweight = 1;
+                    if constexpr(Weighted_) {
+                        curweight = weights[pt];
+                    }
+                    ymean += static_cast<Accumulate_>(y[pt]) * curweight;
+                    allweight += curweight;
+                }
             }
         }
 
@@ -61,79 +308,760 @@ Data_ fit_point (
         return ymean;
     }
 
-    Data_ xmean = 0, ymean = 0, allweight = 0;
-    for (auto pt = left; pt <= right; ++pt) {
-        const Data_ curw = cube(static_cast<Data_>(1) - cube(std::abs(x[curpt] - x[pt])/dist)) * robust_weights[pt];
-        const Data_ current = (weights != NULL ? curw * weights[pt] : curw);
-        xmean += current * x[pt];
-        ymean += current * y[pt];
-        allweight += current;
-        work[pt] = current;
+    const Accumulate_ curx = x[curpt];
+    const auto mom = accumulate_moments<Weighted_, Robust_>(limits, curx, x, y, weights, robust_weights);
+    if constexpr(Robust_) {
+        if (mom.sumw == 0) { // ignore the robustness weights.
+            return fit_point<Weighted_, false, Accumulate_>(curpt, limits, x, y, weights, robust_weights);
+        }
     }
 
-    if (allweight == 0) { // ignore the robustness weights.
+    return solve_moments(mom, [&]() -> Accumulate_ {
+        return solve_centered<Weighted_, Robust_>(limits, curx, x, y, weights, robust_weights, mom);
+    });
+}
+
+/*
+ * Version of fit_point() for anchors that can use the precomputed stencil on
+ * a regular grid (see use_grid_stencil()). This is the same as
+ * accumulate_moments() except that the tricube weights and x-offsets are
+ * loaded from the stencil instead of being computed from 'x'. Without any
+ * prior or robustness weights, the weights are symmetric around the anchor
+ * so the fitted value is just the weighted mean of the y-values.
+ */
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_, typename Index_>
+Data_ fit_point_stencil(
+    const std::size_t curpt,
+    const Window<Data_, Index_>& limits, 
+    const GridStencil<Data_, Index_>& stencil,
+    const Data_* const x,
+    const Data_* const y,
+    const Data_* const weights, 
+    const Data_* const robust_weights)
+{
+    const auto left = curpt - stencil.halfwidth;
+    const auto width = stencil.weights.size();
+    const auto sweights = stencil.weights.data();
+    const auto soffsets = stencil.offsets.data();
+    const auto ystart = y + left;
+
+    if constexpr(!Weighted_ && !Robust_) {
+        std::array<Accumulate_, simd_lanes> sumwy;
+        sumwy.fill(0);
+        std::size_t j = 0;
+        for (; width - j >= simd_lanes; j += simd_lanes) {
+            for (std::size_t l = 0; l < simd_lanes; ++l) {
+                sumwy[l] += static_cast<Accumulate_>(sweights[j + l]) * static_cast<Accumulate_>(ystart[j + l]);
+            }
+        }
+        Accumulate_ output = reduce_lanes(sumwy);
+        for (; j < width; ++j) {
+            output += static_cast<Accumulate_>(sweights[j]) * static_cast<Accumulate_>(ystart[j]);
+        }
+        return output / static_cast<Accumulate_>(stencil.total_weight);
+
+    } else {
+        std::array<Accumulate_, simd_lanes> sumw, sumwx, sumwxx, sumwy, sumwxy;
+        sumw.fill(0);
+        sumwx.fill(0);
+        sumwxx.fill(0);
+        sumwy.fill(0);
+        sumwxy.fill(0);
+
+        auto add = [&](const std::size_t j, Accumulate_& cursumw, Accumulate_& cursumwx, Accumulate_& cursumwxx, Accumulate_& cursumwy, Accumulate_& cursumwxy) -> void {
+            Accumulate_ curw = sweights[j];
+            if constexpr(Robust_) {
+                curw *= robust_weights[left + j];
+            }
+            if constexpr(Weighted_) {
+                curw *= weights[left + j];
+            }
+            const Accumulate_ offset = soffsets[j];
+            const Accumulate_ cwdx = curw * offset;
+            const Accumulate_ yval = ystart[j];
+            cursumw += curw;
+            cursumwx += cwdx;
+            cursumwxx += cwdx * offset;
+            cursumwy += curw * yval;
+            cursumwxy += cwdx * yval;
+        };
+
+        std::size_t j = 0;
+        for (; width - j >= simd_lanes; j += simd_lanes) {
+            for (std::size_t l = 0; l < simd_lanes; ++l) {
+                add(j + l, sumw[l], sumwx[l], sumwxx[l], sumwy[l], sumwxy[l]);
+            }
+        }
+
+        Moments<Accumulate_> mom;
+        mom.sumw = reduce_lanes(sumw);
+        mom.sumwx = reduce_lanes(sumwx);
+        mom.sumwxx = reduce_lanes(sumwxx);
+        mom.sumwy = reduce_lanes(sumwy);
+        mom.sumwxy = reduce_lanes(sumwxy);
+        for (; j < width; ++j) {
+            add(j, mom.sumw, mom.sumwx, mom.sumwxx, mom.sumwy, mom.sumwxy);
+        }
+
+        if constexpr(Robust_) {
+            if (mom.sumw == 0) { // ignore the robustness weights, see fit_point().
+                return fit_point<Weighted_, false, Accumulate_>(curpt, limits, x, y, weights, robust_weights);
+            }
+        }
+
+        return solve_moments(mom, [&]() -> Accumulate_ {
+            return solve_centered<Weighted_, Robust_>(limits, static_cast<Accumulate_>(x[curpt]), x, y, weights, robust_weights, mom);
+        });
+    }
+}
+
+/*
+ * Multi-RHS version of fit_point() for the first (non-robust) iteration, where
+ * the tricube weights only depend on x, the window and the prior weights. We
+ * compute the weights and the x-moments once per window and accumulate the
+ * y-dependent sums for a block of y-vectors at once. The arithmetic for each
+ * y-vector is the same as in fit_point() with all robustness weights set to 1,
+ * so the results are identical.
+ *
+ * All 'Block_' pointers in 'y' should be valid, but only the first 'num_y'
+ * results are actually stored in 'output'. Callers can pad 'y' with repeated
+ * pointers to reuse the fully unrolled kernel for a partial block.
+ */
+template<bool Weighted_, typename Accumulate_, std::size_t Block_, typename Data_, typename Index_>
+void fit_point_batch_moments(
+    const std::size_t curpt,
+    const Window<Data_, Index_>& limits, 
+    const Data_* const x,
+    const std::array<const Data_*, Block_>& y,
+    const std::size_t num_y,
+    const Data_* const weights, 
+    Data_* const* const output)
+{
+    const auto left = limits.left, end = limits.right + 1;
+    const Accumulate_ dist = limits.distance;
+    const Accumulate_ curx = x[curpt];
+
+    std::array<Accumulate_, simd_lanes> current, wdx, sumw, sumwx, sumwxx;
+    sumw.fill(0);
+    sumwx.fill(0);
+    sumwxx.fill(0);
+    std::array<std::array<Accumulate_, simd_lanes>, Block_> sumwy, sumwxy;
+    for (std::size_t b = 0; b < Block_; ++b) {
+        sumwy[b].fill(0);
+        sumwxy[b].fill(0);
+    }
+
+    auto pt = left;
+    for (; end - pt >= simd_lanes; pt += simd_lanes) {
+        compute_lane_weights<Weighted_, false>(pt, curx, dist, x, weights, static_cast<const Data_*>(NULL), current, wdx);
+        for (std::size_t l = 0; l < simd_lanes; ++l) {
+            sumw[l] += current[l];
+            sumwx[l] += wdx[l];
+            sumwxx[l] += wdx[l] * (x[pt + l] - curx);
+        }
+        for (std::size_t b = 0; b < Block_; ++b) {
+            const auto yptr = y[b] + pt;
+            auto& cursumwy = sumwy[b];
+            auto& cursumwxy = sumwxy[b];
+            for (std::size_t l = 0; l < simd_lanes; ++l) {
+                cursumwy[l] += current[l] * yptr[l];
+                cursumwxy[l] += wdx[l] * yptr[l];
+            }
+        }
+    }
+
+    Moments<Accumulate_> common;
+    common.sumw = reduce_lanes(sumw);
+    common.sumwx = reduce_lanes(sumwx);
+    common.sumwxx = reduce_lanes(sumwxx);
+    std::array<Moments<Accumulate_>, Block_> all;
+    for (std::size_t b = 0; b < Block_; ++b) {
+        all[b].sumwy = reduce_lanes(sumwy[b]);
+        all[b].sumwxy = reduce_lanes(sumwxy[b]);
+    }
+
+    // Scalar fallback for the remainder.
+    for (; pt < end; ++pt) {
+        const Accumulate_ dx = static_cast<Accumulate_>(x[pt]) - curx;
+        Accumulate_ curw = tricube(dx, dist);
+        if constexpr(Weighted_) {
+            curw *= weights[pt];
+        }
+        const Accumulate_ cwdx = curw * dx;
+        common.sumw += curw;
+        common.sumwx += cwdx;
+        common.sumwxx += cwdx * dx;
+        for (std::size_t b = 0; b < Block_; ++b) {
+            const Accumulate_ yval = y[b][pt];
+            all[b].sumwy += curw * yval;
+            all[b].sumwxy += cwdx * yval;
+        }
+    }
+
+    for (std::size_t b = 0; b < num_y; ++b) {
+        auto& mom = all[b];
+        mom.sumw = common.sumw;
+        mom.sumwx = common.sumwx;
+        mom.sumwxx = common.sumwxx;
+        output[b][curpt] = solve_moments(mom, [&]() -> Accumulate_ {
+            return solve_centered<Weighted_, false>(limits, curx, x, y[b], weights, static_cast<const Data_*>(NULL), mom);
+        });
+    }
+}
+
+template<typename Accumulate_, std::size_t Block_, typename Data_, typename Index_>
+void fit_point_batch(
+    const std::size_t curpt,
+    const Window<Data_, Index_>& limits, 
+    const Data_* const x,
+    const std::array<const Data_*, Block_>& y,
+    const std::size_t num_y,
+    const Data_* const weights, 
+    Data_* const* const output)
+{
+    const auto left = limits.left, right = limits.right;
+    const Accumulate_ dist = limits.distance;
+
+    if (dist <= 0) {
+        std::array<Accumulate_, Block_> sumwy;
+        sumwy.fill(0);
+        Accumulate_ allweight = 0;
         for (auto pt = left; pt <= right; ++pt) {
-            const Data_ curw = cube(static_cast<Data_>(1) - cube(std::abs(x[curpt] - x[pt])/dist));
-            const Data_ current = (weights != NULL ? curw * weights[pt] : curw);
-            xmean += current * x[pt];
-            ymean += current * y[pt];
-            allweight += current;
-            work[pt] = current;
+            const Accumulate_ curweight = (weights != NULL ? weights[pt] : static_cast<Data_>(1));
+            for (std::size_t b = 0; b < Block_; ++b) {
+                sumwy[b] += static_cast<Accumulate_>(y[b][pt]) * curweight;
+            }
+            allweight += curweight;
+        }
+
+        for (std::size_t b = 0; b < num_y; ++b) {
+            output[b][curpt] = sumwy[b] / allweight;
+        }
+        return;
+    }
+
+    if (weights != NULL) {
+        fit_point_batch_moments<true, Accumulate_>(curpt, limits, x, y, num_y, weights, output);
+    } else {
+        fit_point_batch_moments<false, Accumulate_>(curpt, limits, x, y, num_y, weights, output);
+    }
+}
+
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_, typename Index_>
+void fit_anchors(
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const Data_* const y,
+    Data_* const fitted,
+    const Data_* const weights,
+    const Data_* const robust_weights,
+    const int num_threads,
+    const std::vector<std::size_t>& partition,
+    const unsigned char* const affected
+) {
+    const auto& anchors = windows.anchors;
+    const auto& limits = windows.limits;
+    assert(anchors.size() > 0); // this should be true if num_points > 0.
+
+    parallelize_partition(num_threads, partition, [&](const std::size_t start, const std::size_t end) {
+        for (auto s = start; s < end; ++s) {
+            if (affected != NULL && !affected[s]) {
+                continue;
+            }
+            const auto curpt = anchors[s];
+
+            // Tied anchors with the same window must have the same fitted value, so we just copy it.
+            if (s > start) {
+                const auto prevpt = anchors[s - 1];
+                if (x[prevpt] == x[curpt] && limits[s - 1].left == limits[s].left && limits[s - 1].right == limits[s].right) {
+                    fitted[curpt] = fitted[prevpt];
+                    continue;
+                }
+            }
+
+            if (use_grid_stencil(windows.stencil, curpt, limits[s])) {
+                fitted[curpt] = fit_point_stencil<Weighted_, Robust_, Accumulate_>(curpt, limits[s], windows.stencil, x, y, weights, robust_weights);
+            } else {
+                fitted[curpt] = fit_point<Weighted_, Robust_, Accumulate_>(curpt, limits[s], x, y, weights, robust_weights);
+            }
         }
+    });
+}
+
+/*
+ * Alternative to fit_point() that avoids a pass over each window. On either
+ * side of the anchor, the tricube weight is a polynomial in 't = dx / dist',
+ * i.e., (1 - t^3)^3 = 1 - 3t^3 + 3t^6 - t^9 on the right and (1 + t^3)^3 on
+ * the left. So, the moments for the local regression can be assembled from
+ * power sums of the x-coordinates (up to degree 11) and the y-coordinates
+ * (multiplied by x, up to degree 10), where each point is only weighted by the
+ * product of its prior and robustness weights. These power sums are updated
+ * as the window slides from one anchor to the next, such that the cost per
+ * anchor only depends on the number of points entering or leaving the window.
+ *
+ * To keep this numerically stable, the power sums are computed for 'u = (x -
+ * centre) / scale', where 'centre' and 'scale' are the x-coordinate and
+ * window distance of the anchor at which the sums were last recomputed from
+ * scratch. A binomial shift then moves the sums to the current anchor. We
+ * recompute the sums whenever the current anchor lies more than 'scale' from
+ * 'centre', its window distance is not within a factor of 2 of 'scale', or too
+ * many points have been added and removed since the last recomputation (to
+ * avoid accumulating round-off error). This ensures that |u| <= 3 for all
+ * points in the window, so that an offset in 'x' does not affect the sums.
+ *
+ * However, the degree-11 terms can still be as large as 3^11 ~= 1.8e5 times the
+ * total weight, and most of this magnitude cancels out when the sums are
+ * shifted and combined with the tricube polynomial. The assembled moments
+ * thus have a much larger round-off error than those from fit_point(). We only
+ * use them if the total weight and the variance are large relative to this
+ * error, based on a tolerance of sqrt(epsilon) in fit_anchors_fast(), and
+ * otherwise fall back to the exact calculation in fit_point(). All sums are
+ * computed in at least double precision regardless of 'Data_'.
+ */
+constexpr std::size_t fast_sum_xterms = 12;
+constexpr std::size_t fast_sum_yterms = 11;
+
+template<typename Accumulate_>
+using FastSum = typename std::conditional<(std::numeric_limits<Accumulate_>::digits > std::numeric_limits<double>::digits), Accumulate_, double>::type;
+
+template<typename Sum_>
+struct PowerSums {
+    std::array<Sum_, fast_sum_xterms> wx; // sum of p * u^k.
+    std::array<Sum_, fast_sum_yterms> wy; // sum of p * y * u^k.
+    std::size_t num_nonzero; // number of points with non-zero p, modulo 2^N for intermediate removals.
+
+    void reset() {
+        wx.fill(0);
+        wy.fill(0);
+        num_nonzero = 0;
     }
+};
 
-    xmean /= allweight;
-    ymean /= allweight;
+template<bool Weighted_, bool Robust_, typename Sum_, typename Data_>
+void update_power_sums(
+    PowerSums<Sum_>& sums,
+    const std::size_t from,
+    const std::size_t to,
+    const bool add,
+    const Sum_ centre,
+    const Sum_ inv_scale,
+    const Data_* const x,
+    const Data_* const y,
+    const Data_* const weights,
+    const Data_* const robust_weights)
+{
+    const Sum_ sign = (add ? 1 : -1);
+    for (auto pt = from; pt < to; ++pt) {
+        Sum_ p = sign;
+        if constexpr(Robust_) {
+            if (robust_weights[pt] == 0) {
+                continue;
+            }
+            p *= robust_weights[pt];
+        }
+        if constexpr(Weighted_) {
+            p *= weights[pt];
+        }
+        if (add) {
+            ++sums.num_nonzero;
+        } else {
+            --sums.num_nonzero;
+        }
 
-    Data_ var = 0, covar = 0;
-    for (auto pt = left; pt <= right; ++pt) {
-        const Data_ temp = x[pt] - xmean;
-        var += temp * temp * work[pt];
-        covar += temp * (y[pt] - ymean) * work[pt];
+        const Sum_ u = (static_cast<Sum_>(x[pt]) - centre) * inv_scale;
+        const Sum_ yval = y[pt];
+        for (std::size_t k = 0; k < fast_sum_yterms; ++k) {
+            sums.wx[k] += p;
+            sums.wy[k] += p * yval;
+            p *= u;
+        }
+        sums.wx[fast_sum_yterms] += p;
     }
+}
 
-    // Still possible for var = 0 if all other points have zero weight.
-    if (var == 0) {
-        return ymean;
+/*
+ * Moving one end of the interval of points covered by 'sums' from 'from' to
+ * 'to'. If 'upper = true', this is the (exclusive) upper end, otherwise it is
+ * the (inclusive) lower end. We don't assume that the ends of the interval
+ * stay ordered during the updates, as the power sums are additive for signed
+ * intervals anyway.
+ */
+template<bool Weighted_, bool Robust_, typename Sum_, typename Data_>
+void move_power_sums(
+    PowerSums<Sum_>& sums,
+    const std::size_t from,
+    const std::size_t to,
+    const bool upper,
+    const Sum_ centre,
+    const Sum_ inv_scale,
+    const Data_* const x,
+    const Data_* const y,
+    const Data_* const weights,
+    const Data_* const robust_weights)
+{
+    if (to > from) {
+        update_power_sums<Weighted_, Robust_>(sums, from, to, upper, centre, inv_scale, x, y, weights, robust_weights);
+    } else if (to < from) {
+        update_power_sums<Weighted_, Robust_>(sums, to, from, !upper, centre, inv_scale, x, y, weights, robust_weights);
+    }
+}
+
+template<typename Sum_>
+constexpr std::array<std::array<Sum_, fast_sum_xterms>, fast_sum_xterms> binomial_coefficients() {
+    std::array<std::array<Sum_, fast_sum_xterms>, fast_sum_xterms> output{};
+    for (std::size_t n = 0; n < fast_sum_xterms; ++n) {
+        output[n][0] = 1;
+        for (std::size_t k = 1; k <= n; ++k) {
+            output[n][k] = output[n - 1][k - 1] + output[n - 1][k];
+        }
+    }
+    return output;
+}
+
+/*
+ * Shifting the power sums from 'u' to 'v = u + shift', and then combining
+ * them with the tricube polynomial on each side. 'ratio' is 'scale / dist', so
+ * that 't = v * ratio'. The moments are reported in units of 'scale', which
+ * doesn't matter as the intercept from solve_moments() is invariant to the
+ * scaling of the x-coordinates.
+ */
+template<typename Sum_, std::size_t Size_>
+std::array<Sum_, Size_> shift_power_sums(const std::array<Sum_, Size_>& sums, const std::array<Sum_, fast_sum_xterms>& shift_powers) {
+    constexpr auto binom = binomial_coefficients<Sum_>();
+    std::array<Sum_, Size_> output;
+    for (std::size_t k = 0; k < Size_; ++k) {
+        Sum_ current = 0;
+        for (std::size_t j = 0; j <= k; ++j) {
+            current += binom[k][j] * shift_powers[k - j] * sums[j];
+        }
+        output[k] = current;
+    }
+    return output;
+}
+
+template<typename Sum_>
+Moments<Sum_> assemble_moments(const PowerSums<Sum_>& lower, const PowerSums<Sum_>& upper, const Sum_ shift, const Sum_ ratio) {
+    std::array<Sum_, fast_sum_xterms> shift_powers;
+    shift_powers[0] = 1;
+    for (std::size_t k = 1; k < fast_sum_xterms; ++k) {
+        shift_powers[k] = shift_powers[k - 1] * shift;
+    }
+
+    const auto lx = shift_power_sums(lower.wx, shift_powers);
+    const auto ly = shift_power_sums(lower.wy, shift_powers);
+    const auto ux = shift_power_sums(upper.wx, shift_powers);
+    const auto uy = shift_power_sums(upper.wy, shift_powers);
+
+    const Sum_ r3 = cube(ratio), r6 = r3 * r3, r9 = r6 * r3;
+    auto combine = [&](const auto& left, const auto& right, const std::size_t m) -> Sum_ {
+        const Sum_ lsum = left[m] + 3 * r3 * left[m + 3] + 3 * r6 * left[m + 6] + r9 * left[m + 9];
+        const Sum_ rsum = right[m] - 3 * r3 * right[m + 3] + 3 * r6 * right[m + 6] - r9 * right[m + 9];
+        return lsum + rsum;
+    };
+
+    Moments<Sum_> output;
+    output.sumw = combine(lx, ux, 0);
+    output.sumwx = combine(lx, ux, 1);
+    output.sumwxx = combine(lx, ux, 2);
+    output.sumwy = combine(ly, uy, 0);
+    output.sumwxy = combine(ly, uy, 1);
+    return output;
+}
+
+template<bool Weighted_, bool Robust_, typename Accumulate_, typename Data_, typename Index_>
+void fit_anchors_fast(
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const Data_* const y,
+    Data_* const fitted,
+    const Data_* const weights,
+    const Data_* const robust_weights,
+    const int num_threads,
+    const std::vector<std::size_t>& partition,
+    const unsigned char* const affected
+) {
+    typedef FastSum<Accumulate_> Sum;
+    const auto& anchors = windows.anchors;
+    const auto& limits = windows.limits;
+    assert(anchors.size() > 0); // this should be true if num_points > 0.
+
+    // Looser than the default in solve_moments(), to account for the extra
+    // round-off error in the power sums (see comments above).
+    const Sum tolerance = std::sqrt(std::numeric_limits<Sum>::epsilon());
+
+    parallelize_partition(num_threads, partition, [&](const std::size_t start, const std::size_t end) {
+        // 'lower' covers '[lo, mid)' and 'upper' covers '[mid, hi)'.
+        PowerSums<Sum> lower, upper;
+        std::size_t lo = 0, mid = 0, hi = 0, num_updates = 0;
+        Sum centre = 0, scale = 0, inv_scale = 0;
+        bool initialized = false;
+
+        for (auto s = start; s < end; ++s) {
+            if (affected != NULL && !affected[s]) {
+                continue;
+            }
+            const auto curpt = anchors[s];
+            const auto& curlim = limits[s];
+
+            // Tied anchors with the same window must have the same fitted value, so we just copy it.
+            if (s > start) {
+                const auto prevpt = anchors[s - 1];
+                if (x[prevpt] == x[curpt] && limits[s - 1].left == curlim.left && limits[s - 1].right == curlim.right) {
+                    fitted[curpt] = fitted[prevpt];
+                    continue;
+                }
+            }
+
+            const Sum dist = curlim.distance;
+            if (dist <= 0) {
+                fitted[curpt] = fit_point<Weighted_, Robust_, Accumulate_>(curpt, curlim, x, y, weights, robust_weights);
+                continue;
+            }
+
+            const Sum curx = x[curpt];
+            const std::size_t left = curlim.left, right = static_cast<std::size_t>(curlim.right) + 1;
+            auto absdiff = [](const std::size_t a, const std::size_t b) -> std::size_t { return (a > b ? a - b : b - a); };
+            const auto num_moves = absdiff(left, lo) + absdiff(curpt, mid) + absdiff(right, hi);
+
+            if (
+                !initialized ||
+                num_updates + num_moves > 2 * (right - left) ||
+                std::abs(curx - centre) > scale ||
+                dist * 2 < scale ||
+                dist > scale * 2
+            ) {
+                centre = curx;
+                scale = dist;
+                inv_scale = 1 / scale;
+                lower.reset();
+                upper.reset();
+                update_power_sums<Weighted_, Robust_>(lower, left, curpt, true, centre, inv_scale, x, y, weights, robust_weights);
+                update_power_sums<Weighted_, Robust_>(upper, curpt, right, true, centre, inv_scale, x, y, weights, robust_weights);
+                num_updates = 0;
+                initialized = true;
+            } else {
+                move_power_sums<Weighted_, Robust_>(lower, lo, left, false, centre, inv_scale, x, y, weights, robust_weights);
+                move_power_sums<Weighted_, Robust_>(lower, mid, curpt, true, centre, inv_scale, x, y, weights, robust_weights);
+                move_power_sums<Weighted_, Robust_>(upper, mid, curpt, false, centre, inv_scale, x, y, weights, robust_weights);
+                move_power_sums<Weighted_, Robust_>(upper, hi, right, true, centre, inv_scale, x, y, weights, robust_weights);
+                num_updates += num_moves;
+            }
+            lo = left;
+            mid = curpt;
+            hi = right;
+
+            if (lower.num_nonzero + upper.num_nonzero > 0) {
+                const auto mom = assemble_moments(lower, upper, (centre - curx) * inv_scale, scale / dist);
+                if (mom.sumw > tolerance * (lower.wx[0] + upper.wx[0])) {
+                    fitted[curpt] = solve_moments(
+                        mom,
+                        [&]() -> Accumulate_ { return fit_point<Weighted_, Robust_, Accumulate_>(curpt, curlim, x, y, weights, robust_weights); },
+                        tolerance
+                    );
+                    continue;
+                }
+            }
+
+            // Falling back to the exact calculation when all points have zero weight,
+            // so that the robustness weights are ignored in the same manner as fit_point().
+            fitted[curpt] = fit_point<Weighted_, Robust_, Accumulate_>(curpt, curlim, x, y, weights, robust_weights);
+        }
+    });
+}
+
+/*
+ * Partitioning the anchors between threads by their window sizes, as the cost
+ * of each fit is proportional to the number of points in its window.
+ */
+template<typename Data_, typename Index_>
+void partition_anchors(const PrecomputedWindows<Data_, Index_>& windows, const int num_threads, std::vector<std::size_t>& partition) {
+    const auto& limits = windows.limits;
+    partition_by_cost(limits.size(), num_threads, [&](const std::size_t s) -> std::size_t { return limits[s].right - limits[s].left + 1; }, partition);
+}
+
+/*
+ * Dispatching to the appropriate specialization of fit_point() once per
+ * iteration. 'robust_weights' may be NULL, in which case all robustness
+ * weights are assumed to be equal to 1. 'affected' may be NULL, otherwise
+ * only anchors with non-zero 'affected' values are refitted.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+void fit_anchors(
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const Data_* const y,
+    Data_* const fitted,
+    const Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt,
+    const std::vector<std::size_t>& partition,
+    const unsigned char* const affected
+) {
+    if (opt.fast_sums) {
+        if (opt.weights != NULL) {
+            if (robust_weights != NULL) {
+                fit_anchors_fast<true, true, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+            } else {
+                fit_anchors_fast<true, false, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+            }
+        } else {
+            if (robust_weights != NULL) {
+                fit_anchors_fast<false, true, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+            } else {
+                fit_anchors_fast<false, false, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+            }
+        }
+        return;
+    }
+
+    if (opt.weights != NULL) {
+        if (robust_weights != NULL) {
+            fit_anchors<true, true, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+        } else {
+            fit_anchors<true, false, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+        }
     } else {
-        const Data_ slope = covar / var;
-        const Data_ intercept = ymean - slope * xmean;
-        return slope * x[curpt] + intercept;
+        if (robust_weights != NULL) {
+            fit_anchors<false, true, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+        } else {
+            fit_anchors<false, false, Accumulate_>(x, windows, y, fitted, opt.weights, robust_weights, opt.num_threads, partition, affected);
+        }
     }
 }
 
+/* Perform interpolation between anchor points. This assumes that the first
+ * anchor is the first point and the last anchor is the last point (see
+ * find_anchors() for an example). Note that we do this in a separate parallel
+ * session from the anchor fitting ensure that all 'fitted' values are
+ * available for all anchors across all threads.
+ *
+ * We parallelize across x rather than across the anchor segments, as the
+ * segments may contain very different numbers of points. Each thread computes
+ * the slope and intercept on the fly for each (partial) segment in its range,
+ * so the inner loop is still a simple SIMD-able pass over contiguous points.
+ *
+ * If 'affected' is not NULL, only the segments next to an affected anchor are
+ * interpolated, as all other segments are unchanged from the previous call.
+ */
+template<typename Accumulate_, typename Data_, typename Index_>
+void interpolate_anchors(
+    const Data_* const x,
+    const std::vector<Index_>& anchors,
+    Data_* const fitted,
+    const int num_threads,
+    const unsigned char* const affected = NULL
+) {
+    const auto num_anchors_m1 = anchors.size() - 1;
+    parallelize_segments(
+        num_anchors_m1,
+        [&](const std::size_t s) -> std::size_t { return anchors[s]; },
+        num_threads,
+        [&](const std::size_t s, std::size_t first, const std::size_t last) -> void {
+            if (affected != NULL && !affected[s] && !affected[s + 1]) {
+                return;
+            }
+            const auto left_anchor = anchors[s];
+            const auto right_anchor = anchors[s + 1];
+            first = std::max(first, static_cast<std::size_t>(left_anchor) + 1); // skipping the left anchor itself.
+            if (first >= last) {
+                return;
+            }
+
+            const Accumulate_ xdiff = static_cast<Accumulate_>(x[right_anchor]) - static_cast<Accumulate_>(x[left_anchor]);
+            const Accumulate_ ydiff = static_cast<Accumulate_>(fitted[right_anchor]) - static_cast<Accumulate_>(fitted[left_anchor]);
+            if (xdiff > 0) {
+                const Accumulate_ slope = ydiff / xdiff;
+                const Accumulate_ intercept = fitted[right_anchor] - slope * x[right_anchor];
+                for (auto subpt = first; subpt < last; ++subpt) { 
+                    fitted[subpt] = slope * x[subpt] + intercept; 
+                }
+            } else {
+                /* Some protection is provided against infinite slopes.
+                 * This shouldn't be a problem for non-zero delta; the only
+                 * concern is at the final point where the covariate
+                 * distance may be zero.
+                 */
+                const Data_ ave = fitted[left_anchor] + ydiff / 2;
+                std::fill(fitted + first, fitted + last, ave);
+            }
+        }
+    );
+}
+
+/*
+ * Identifying the anchors whose windows contain at least one point with a
+ * robustness weight that changed by more than 'threshold' since the previous
+ * iteration. Only these anchors need to be refitted in the next iteration.
+ * Rather than building an interval index over the windows, we compute the
+ * cumulative number of changed points so that each window can be checked
+ * in constant time from its boundaries. Returns the number of affected anchors.
+ */
+template<typename Data_, typename Index_>
+std::size_t find_affected_anchors(
+    const std::size_t num_points,
+    const Data_* const previous,
+    const Data_* const current,
+    const Data_ threshold,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    std::vector<std::size_t>& num_changed,
+    std::vector<unsigned char>& affected)
+{
+    sanisizer::resize(num_changed, sanisizer::sum<std::size_t>(num_points, 1));
+    num_changed[0] = 0;
+    for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
+        num_changed[i + 1] = num_changed[i] + (std::abs(current[i] - previous[i]) > threshold);
+    }
+
+    const auto& limits = windows.limits;
+    const auto num_anchors = limits.size();
+    sanisizer::resize(affected, num_anchors);
+    std::size_t num_affected = 0;
+    for (I<decltype(num_anchors)> s = 0; s < num_anchors; ++s) {
+        affected[s] = (num_changed[static_cast<std::size_t>(limits[s].right) + 1] > num_changed[limits[s].left]);
+        num_affected += affected[s];
+    }
+    return num_affected;
+}
+
 /* This is a C++ version of the local weighted regression (lowess) trend fitting algorithm,
  * based on the Fortran code in lowess.f from http://www.netlib.org/go written by Cleveland.
  * Consideration of non-equal prior weights is added to the span calculations and linear
  * regression. These weights are intended to have the equivalent effect of frequency weights
  * (at least, in the integer case; extended by analogy to all non-negative values).
+ *
+ * Returns the number of robustness iterations that were actually performed,
+ * i.e., the number of fits after the first.
  */
-template<typename Data_>
-void fit_trend(
+template<typename Data_, typename Index_, typename Accumulate_>
+int fit_trend(
     const std::size_t num_points,
     const Data_* const x,
-    const PrecomputedWindows<Data_>& windows,
+    const PrecomputedWindows<Data_, Index_>& windows,
     const Data_* const y,
     Data_* const fitted,
     Data_* const robust_weights,
-    const Options<Data_>& opt
+    const Options<Data_, Accumulate_>& opt,
+    Workspace<Data_, Index_>& workspace,
+    const bool prefitted = false
 ) {
     if (num_points == 0) {
-        return;
+        return 0;
     }
 
     const auto& anchors = windows.anchors;
     const auto freq_weights = windows.freq_weights;
     const Data_ totalweight = windows.total_weight;
-    const auto& limits = windows.limits;
 
-    // Setting up the robustness weights, if robustification is requested.
-    std::fill_n(robust_weights, num_points, 1);
+    /* The robustness weights are not filled with 1 until we know that no
+     * robustness iterations will be performed. Before then, the first fit
+     * uses the non-robust specialization and never reads 'robust_weights'.
+     * The exception is a warm start, where the first fit uses the existing
+     * robustness weights (possibly derived from the existing fitted values).
+     */
     Data_ min_threshold = 0; 
-    std::vector<std::size_t> residual_permutation;
     constexpr Data_ threshold_multiplier = 1e-8;
+    const bool warm = (opt.warm_start != WarmStart::NONE);
 
-    if (opt.iterations) {
+    if (opt.iterations || opt.warm_start == WarmStart::FITTED) {
         /* If the range of 'y' is zero, we just quit early. Otherwise, we use
          * the range to set a lower bound on the robustness threshold to avoid
          * problems with divide-by-zero. We don't use the MAD of 'y' as it
@@ -143,71 +1071,47 @@ void fit_trend(
         const Data_ range = (*std::max_element(y, y + num_points) - *std::min_element(y, y + num_points));
         if (range == 0) {
             std::copy_n(y, num_points, fitted);
-            return;
+            std::fill_n(robust_weights, num_points, 1);
+            return 0;
         }
         min_threshold = range * threshold_multiplier;
     }
 
-    auto workspaces = sanisizer::create<std::vector<std::vector<Data_> > >(opt.num_threads);
+    auto& partition = workspace.partition;
+    partition_anchors(windows, opt.num_threads, partition);
 
-    I<decltype(opt.iterations)> it = 0;
-    while (1) { // Robustness iterations.
-        const auto num_anchors = anchors.size();
-        assert(num_anchors > 0); // this should be true if num_points > 0.
-
-        parallelize(opt.num_threads, num_anchors, [&](const int t, const I<decltype(num_anchors)> start, const I<decltype(num_anchors)> length) {
-            auto& workspace = workspaces[t];
-            sanisizer::resize(workspace, num_points); // resizing here to encourage allocations to a thread-specific heap to avoid false sharing.
-            for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
-                const auto curpt = anchors[s];
-                fitted[curpt] = fit_point(curpt, limits[s], x, y, opt.weights, robust_weights, workspace);
-            }
-        });
+    // For incremental robustness iterations, 'affected' is only used after
+    // the first robust fit, as all anchors need to be refitted before then.
+    const bool incremental = opt.incremental_threshold.has_value();
+    const unsigned char* affected = NULL;
+    const bool converging = opt.convergence_tolerance.has_value();
 
-        /* Perform interpolation between anchor points. This assumes that the first
-         * anchor is the first point and the last anchor is the last point (see
-         * find_anchors() for an example). Note that we do this in a separate parallel
-         * session from the anchor fitting ensure that all 'fitted' values are
-         * available for all anchors across all threads.
-         *
-         * One would think that we should parallelize across x instead of the anchors,
-         * as this has better worksharing when x is not evenly distributed across anchor segments.
-         * However, if we did so, we'd have to store the slope and intercept for the anchor segments first,
-         * then look up the slope and intercept for each element of x.
-         * This involves an extra memory access and is not SIMD-able.
-         */
-        const auto num_anchors_m1 = num_anchors - 1;
-        parallelize(opt.num_threads, num_anchors_m1, [&](const int, const I<decltype(num_anchors_m1)> start, const I<decltype(num_anchors_m1)> length) {
-            for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
-                const auto left_anchor = anchors[s];
-                const auto right_anchor = anchors[s + 1];
-                if (right_anchor - left_anchor <= 1) { // only interpolate if there are points between anchors.
-                    continue;
-                }
+    auto& abs_dev = workspace.abs_dev;
+    auto compute_robust_threshold = [&]() -> Data_ {
+        auto cmad = compute_mad<Data_, Accumulate_>(num_points, y, fitted, freq_weights, totalweight, abs_dev, workspace.values, workspace.permutation, opt.num_threads);
+        cmad *= 6;
+        return std::max(cmad, min_threshold); // avoid difficulties from numerical precision when all residuals are theoretically zero.
+    };
 
-                const Data_ xdiff = x[right_anchor] - x[left_anchor];
-                const Data_ ydiff = fitted[right_anchor] - fitted[left_anchor];
-                if (xdiff > 0) {
-                    const Data_ slope = ydiff / xdiff;
-                    const Data_ intercept = fitted[right_anchor] - slope * x[right_anchor];
-                    for (I<decltype(right_anchor)> subpt = left_anchor + 1; subpt < right_anchor; ++subpt) { 
-                        fitted[subpt] = slope * x[subpt] + intercept; 
-                    }
-                } else {
-                    /* Some protection is provided against infinite slopes.
-                     * This shouldn't be a problem for non-zero delta; the only
-                     * concern is at the final point where the covariate
-                     * distance may be zero.
-                     */
-                    const Data_ ave = fitted[left_anchor] + ydiff / 2;
-                    std::fill(fitted + left_anchor + 1, fitted + right_anchor, ave);
-                }
-            }
-        });
+    if (opt.warm_start == WarmStart::FITTED) {
+        populate_robust_weights(abs_dev, compute_robust_threshold(), robust_weights);
+    }
+
+    I<decltype(opt.iterations)> it = 0;
+    while (1) { // Robustness iterations.
+        // If 'prefitted = true', the caller has already computed the non-robust fits for all anchors, e.g., with fit_point_batch().
+        const bool robust_fit = (it > 0 || warm);
+        if (it > 0 || !prefitted) {
+            fit_anchors(x, windows, y, fitted, (robust_fit ? robust_weights : static_cast<const Data_*>(NULL)), opt, partition, affected);
+        }
+        interpolate_anchors<Accumulate_>(x, anchors, fitted, opt.num_threads, affected);
 
         // Using a manual break to avoid overflow of 'it' in a for loop that requires
         // one last iteration at 'it == opt.iterations'.
         if (it == opt.iterations) {
+            if (!robust_fit) {
+                std::fill_n(robust_weights, num_points, 1);
+            }
             break;
         }
 
@@ -221,7 +1125,7 @@ void fit_trend(
          * as most residuals are fine, and we would terminate early and fail to
          * robustify against the few outliers.
          */
-        if (it > 0) {
+        if (robust_fit) {
             /* That said, we do quit if the range of the non-outlier points
              * is exactly zero, because that implies that we should already
              * have a perfect fit among all of these points.
@@ -239,19 +1143,54 @@ void fit_trend(
             min_threshold = range * threshold_multiplier;
         }
 
-        // Just using the first workspace as a spare buffer, not using any values therein.
-        // This is GUARANTEED to be properly sized, as num_anchors > 0 when num_points > 0.
-        // Thus parallelize() will always run for t = 0, causing the first workspace to be resized.
-        auto& abs_dev = workspaces.front();
+        const auto cmad = compute_robust_threshold();
+        if (!incremental && !converging) {
+            populate_robust_weights(abs_dev, cmad, robust_weights);
+        } else {
+            // Before the first robust fit, all robustness weights are implicitly equal to 1.
+            auto& previous = workspace.previous_robust_weights;
+            sanisizer::resize(previous, num_points);
+            if (robust_fit) {
+                std::copy_n(robust_weights, num_points, previous.data());
+            } else {
+                std::fill(previous.begin(), previous.end(), 1);
+            }
+            populate_robust_weights(abs_dev, cmad, robust_weights);
 
-        auto cmad = compute_mad(num_points, y, fitted, freq_weights, totalweight, abs_dev, residual_permutation);
-        cmad *= 6;
-        cmad = std::max(cmad, min_threshold); // avoid difficulties from numerical precision when all residuals are theoretically zero.
-        populate_robust_weights(abs_dev, cmad, robust_weights);
+            /* Unlike the MAD-based rule described above, this checks whether
+             * the robustness weights have stabilized for all points, so it is
+             * not fooled by a minority of points near an outlier.
+             */
+            if (converging && max_abs_diff(num_points, previous.data(), robust_weights) <= *(opt.convergence_tolerance)) {
+                break;
+            }
+
+            if (incremental && robust_fit) {
+                const auto num_affected = find_affected_anchors(num_points, previous.data(), robust_weights, *(opt.incremental_threshold), windows, workspace.num_changed, workspace.affected);
+                if (num_affected == 0) { // all further iterations would not change the fitted values.
+                    break;
+                }
+                affected = workspace.affected.data();
+            }
+        }
         ++it;
     }
 
-    return;
+    return it;
+}
+
+template<typename Data_, typename Index_, typename Accumulate_>
+int fit_trend(
+    const std::size_t num_points,
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const Data_* const y,
+    Data_* const fitted,
+    Data_* const robust_weights,
+    const Options<Data_, Accumulate_>& opt
+) {
+    Workspace<Data_, Index_> workspace;
+    return fit_trend(num_points, x, windows, y, fitted, robust_weights, opt, workspace);
 }
 
 }
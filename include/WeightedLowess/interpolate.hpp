@@ -2,6 +2,7 @@
 #define WEIGHTEDLOWESS_INTERPOLATE_HPP
 
 #include <vector>
+#include <algorithm>
 #include <cstddef>
 #include <utility>
 #include <cassert>
@@ -38,6 +39,7 @@ struct AssignedSegments {
  * Segments are defined as the line between two adjacent anchors, to be used for linear interpolation of any intervening points.
  *
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
  *
  * @param[in] x_fit Pointer to an array of x-coordinates for the fitted trend from `compute()`.
  * This should be sorted in increasing order.
@@ -49,10 +51,10 @@ struct AssignedSegments {
  * @return Assignment of each point in `x_out` to its corresponding segment, where possible.
  * This can be re-used for multiple `interpolate()` calls with different `fitted` values.
  */
-template<typename Data_>
+template<typename Data_, typename Index_>
 AssignedSegments assign_to_segments(
     const Data_* const x_fit,
-    const PrecomputedWindows<Data_>& windows_fit,
+    const PrecomputedWindows<Data_, Index_>& windows_fit,
     const std::size_t num_points_out,
     const Data_* const x_out
 ) {
@@ -109,6 +111,8 @@ inline std::pair<std::size_t, std::size_t> get_interpolation_boundaries(const As
  * This function applies the same interpolation to a separate set of points based only on their x-coordinates.
  *
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type used to compute the slope and intercept of each segment, see `Options`.
  *
  * @param[in] x_fit Pointer to an array of x-coordinates for the fitted trend from `compute()`.
  * This should be sorted in increasing order.
@@ -124,10 +128,10 @@ inline std::pair<std::size_t, std::size_t> get_interpolation_boundaries(const As
  * No value is stored for points that lie beyond the interpolation boundaries.
  * @param num_threads Number of threads to use.
  */
-template<typename Data_>
+template<typename Data_, typename Index_, typename Accumulate_ = Data_>
 void interpolate(
     const Data_* const x_fit,
-    const PrecomputedWindows<Data_>& windows_fit,
+    const PrecomputedWindows<Data_, Index_>& windows_fit,
     const Data_* const fitted_fit,
     const Data_* const x_out,
     const AssignedSegments& assigned_out,
@@ -139,26 +143,21 @@ void interpolate(
     assert(num_anchors > 0);
     const auto num_anchors_m1 = num_anchors - 1;
 
-    // One would think that we should parallelize across x_out instead of anchors,
-    // as this has better worksharing when x_out is not evenly distributed across anchor segments.
-    // However, if we did so, we'd have to store the slope and intercept for the anchor segments first,
-    // then look up the slope and intercept for each element of x_out.
-    // This involves an extra memory access and is not SIMD-able.
-    parallelize(num_threads, num_anchors_m1, [&](const int, const I<decltype(num_anchors_m1)> start, const I<decltype(num_anchors_m1)> length) {
-        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
-            const auto run_start = assigned_out.boundaries[s];
-            const auto run_end = assigned_out.boundaries[s + 1];
-            if (run_start == run_end) {
-                continue;
-            }
-
-            const auto left_anchor = windows_fit.anchors[s];
-            const auto right_anchor = windows_fit.anchors[s + 1];
-            const Data_ xdiff = x_fit[right_anchor] - x_fit[left_anchor];
-            const Data_ ydiff = fitted_fit[right_anchor] - fitted_fit[left_anchor];
+    // We parallelize across x_out rather than the anchor segments, as x_out
+    // may not be evenly distributed across segments. Each thread computes the
+    // slope and intercept for each (partial) segment in its range of x_out.
+    internal::parallelize_segments(
+        num_anchors_m1,
+        [&](const std::size_t s) -> std::size_t { return assigned_out.boundaries[s]; },
+        num_threads,
+        [&](const std::size_t s, const std::size_t run_start, const std::size_t run_end) -> void {
+            const auto left_anchor = anchors[s];
+            const auto right_anchor = anchors[s + 1];
+            const Accumulate_ xdiff = static_cast<Accumulate_>(x_fit[right_anchor]) - static_cast<Accumulate_>(x_fit[left_anchor]);
+            const Accumulate_ ydiff = static_cast<Accumulate_>(fitted_fit[right_anchor]) - static_cast<Accumulate_>(fitted_fit[left_anchor]);
             if (xdiff > 0) {
-                const Data_ slope = ydiff / xdiff;
-                const Data_ intercept = fitted_fit[right_anchor] - slope * x_fit[right_anchor];
+                const Accumulate_ slope = ydiff / xdiff;
+                const Accumulate_ intercept = fitted_fit[right_anchor] - slope * x_fit[right_anchor];
                 for (auto outpt = run_start; outpt < run_end; ++outpt) {
                     fitted_out[outpt] = slope * x_out[outpt] + intercept; 
                 }
@@ -168,13 +167,15 @@ void interpolate(
                 std::fill(fitted_out + run_start, fitted_out + run_end, ave);
             }
         }
-    });
+    );
 }
 
 /**
  * Overload of `interpolate()` that calls `assign_to_segments()` automatically.
  *
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type used to compute the slope and intercept of each segment, see `Options`.
  *
  * @param[in] x_fit Pointer to an array of x-coordinates for the fitted trend from `compute()`.
  * This should be sorted in increasing order.
@@ -191,10 +192,10 @@ void interpolate(
  *
  * @return Boundaries of the interpolation, see `get_interpolation_boundaries()` for details.
  */
-template<typename Data_>
+template<typename Data_, typename Index_, typename Accumulate_ = Data_>
 std::pair<std::size_t, std::size_t> interpolate(
     const Data_* const x_fit,
-    const PrecomputedWindows<Data_>& windows_fit,
+    const PrecomputedWindows<Data_, Index_>& windows_fit,
     const Data_* const fitted_fit,
     const std::size_t num_points_out,
     const Data_* const x_out,
@@ -202,7 +203,7 @@ std::pair<std::size_t, std::size_t> interpolate(
     int num_threads
 ) {
     const auto assigned_out = assign_to_segments(x_fit, windows_fit, num_points_out, x_out);
-    interpolate(x_fit, windows_fit, fitted_fit, x_out, assigned_out, fitted_out, num_threads);
+    interpolate<Data_, Index_, Accumulate_>(x_fit, windows_fit, fitted_fit, x_out, assigned_out, fitted_out, num_threads);
     return get_interpolation_boundaries(assigned_out);
 }
 
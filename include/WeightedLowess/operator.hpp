@@ -0,0 +1,325 @@
+#ifndef WEIGHTEDLOWESS_OPERATOR_HPP
+#define WEIGHTEDLOWESS_OPERATOR_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cassert>
+#include <stdexcept>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "fit.hpp"
+#include "window.hpp"
+#include "Options.hpp"
+#include "parallelize.hpp"
+#include "utils.hpp"
+
+/**
+ * @file operator.hpp
+ * @brief Express the LOWESS smoother as a linear operator.
+ */
+
+namespace WeightedLowess {
+
+/**
+ * @brief LOWESS smoother as a sparse linear operator.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums when applying the operator, see `Options`.
+ *
+ * Without any robustness iterations, the fitted value for each anchor is a linear combination of the y-coordinates in its window,
+ * and the fitted value for each non-anchor point is a linear interpolation of the fitted values of the flanking anchors.
+ * This class stores the coefficients of both steps so that the smoother can be applied to new y-vectors without recomputing the tricube weights or the regressions.
+ *
+ * Instances of this class are typically created by `define_operator()` and used in `apply_operator()`.
+ */
+template<typename Data_, typename Index_ = std::size_t, typename Accumulate_ = Data_>
+struct SmoothingOperator {
+    /**
+     * @cond
+     */
+    std::size_t num_points = 0;
+    std::vector<Index_> anchors;
+
+    // Compressed sparse rows for each anchor. As each window is a contiguous
+    // interval of points, we only need to store the first point of each row.
+    // The offsets index into the concatenation of all rows, which can be
+    // longer than the number of points, so they are not stored as 'Index_'.
+    std::vector<Index_> starts;
+    std::vector<std::size_t> offsets;
+    std::vector<Data_> values;
+
+    // Interpolation coefficient for each non-anchor point, i.e., the proportion
+    // of the distance between the left and right flanking anchors.
+    std::vector<Data_> interpolation;
+    /**
+     * @endcond
+     */
+};
+
+/**
+ * @cond
+ */
+namespace internal {
+
+/*
+ * The coefficients are computed in 'Accumulate_' with the same moments and the
+ * same treatment of a near-zero variance as fit_point() with 'Robust_ = false',
+ * so that the operator reproduces the fitted values from compute().
+ */
+template<typename Accumulate_, typename Data_, typename Index_>
+void fill_operator_row(
+    const std::size_t curpt,
+    const Window<Data_, Index_>& limits,
+    const Data_* const x,
+    const Data_* const weights,
+    Data_* const values)
+{
+    const auto left = limits.left, right = limits.right;
+    const Accumulate_ dist = limits.distance;
+
+    auto prior_weight = [&](const std::size_t pt) -> Accumulate_ {
+        return (weights != NULL ? static_cast<Accumulate_>(weights[pt]) : static_cast<Accumulate_>(1));
+    };
+
+    if (dist <= 0) {
+        Accumulate_ allweight = 0;
+        for (auto pt = left; pt <= right; ++pt) {
+            allweight += prior_weight(pt);
+        }
+        for (auto pt = left; pt <= right; ++pt) {
+            values[pt - left] = prior_weight(pt) / allweight;
+        }
+        return;
+    }
+
+    // Tricube weights are recomputed in each pass, rather than being stored
+    // in 'values', to avoid truncating them to 'Data_'.
+    const Accumulate_ curx = x[curpt];
+    auto point_info = [&](const std::size_t pt, Accumulate_& dx) -> Accumulate_ {
+        dx = static_cast<Accumulate_>(x[pt]) - curx;
+        return tricube(dx, dist) * prior_weight(pt);
+    };
+
+    Moments<Accumulate_> mom;
+    for (auto pt = left; pt <= right; ++pt) {
+        Accumulate_ dx;
+        const Accumulate_ curw = point_info(pt, dx);
+        const Accumulate_ cwdx = curw * dx;
+        mom.sumw += curw;
+        mom.sumwx += cwdx;
+        mom.sumwxx += cwdx * dx;
+    }
+
+    /* The fitted value is 'ymean - slope * xmean' as the x-coordinates are
+     * centered at the anchor, where 'ymean' and 'slope' are both linear in
+     * 'y'. As the weighted sum of 'x - xmean' is zero, the slope simplifies to
+     * 'sum(w * (x - xmean) * y) / var'.
+     *
+     * If the one-pass variance is untrustworthy, we fall back to a second pass
+     * as in solve_centered(). This uses 'y - ymean' in the covariance, so we
+     * need to account for the fact that the computed sum of 'w * (x - xmean)'
+     * is not exactly zero due to rounding error in 'xmean'.
+     */
+    const Accumulate_ xmean = mom.sumwx / mom.sumw;
+    Accumulate_ var = mom.sumwxx - xmean * mom.sumwx;
+    Accumulate_ xresidual = 0;
+    if (var <= mom.sumwxx * moment_tolerance<Accumulate_>()) {
+        var = 0;
+        for (auto pt = left; pt <= right; ++pt) {
+            Accumulate_ dx;
+            const Accumulate_ curw = point_info(pt, dx);
+            const Accumulate_ cwdx = curw * (dx - xmean);
+            var += cwdx * (dx - xmean);
+            xresidual += cwdx;
+        }
+        if (is_centered_variance_zero(var, mom.sumw, dist)) {
+            var = 0;
+        }
+    }
+
+    const Accumulate_ leverage = (var == 0 ? static_cast<Accumulate_>(0) : -xmean / var);
+    const Accumulate_ mean_scale = (1 - leverage * xresidual) / mom.sumw;
+    for (auto pt = left; pt <= right; ++pt) {
+        Accumulate_ dx;
+        const Accumulate_ curw = point_info(pt, dx);
+        values[pt - left] = curw * mean_scale + leverage * curw * (dx - xmean);
+    }
+}
+
+template<typename Data_, typename Index_, typename Accumulate_>
+void apply_operator_anchors(const SmoothingOperator<Data_, Index_, Accumulate_>& op, const Data_* const y, Data_* const fitted, const int num_threads) {
+    const auto num_anchors = op.anchors.size();
+    parallelize(num_threads, num_anchors, [&](const int, const I<decltype(num_anchors)> start, const I<decltype(num_anchors)> length) {
+        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
+            const auto offset = op.offsets[s];
+            const auto len = op.offsets[s + 1] - offset;
+            const auto vptr = op.values.data() + offset;
+            const auto yptr = y + op.starts[s];
+            Accumulate_ val = 0;
+            for (I<decltype(len)> i = 0; i < len; ++i) {
+                val += static_cast<Accumulate_>(vptr[i]) * static_cast<Accumulate_>(yptr[i]);
+            }
+            fitted[op.anchors[s]] = val;
+        }
+    });
+}
+
+template<typename Data_, typename Index_, typename Accumulate_>
+void apply_operator_interpolation(const SmoothingOperator<Data_, Index_, Accumulate_>& op, Data_* const fitted, const int num_threads) {
+    const auto& anchors = op.anchors;
+    const auto num_anchors_m1 = anchors.size() - 1;
+    parallelize(num_threads, num_anchors_m1, [&](const int, const I<decltype(num_anchors_m1)> start, const I<decltype(num_anchors_m1)> length) {
+        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
+            const auto left_anchor = anchors[s];
+            const auto right_anchor = anchors[s + 1];
+            const Accumulate_ leftfit = fitted[left_anchor];
+            const Accumulate_ ydiff = static_cast<Accumulate_>(fitted[right_anchor]) - leftfit;
+            for (I<decltype(right_anchor)> subpt = left_anchor + 1; subpt < right_anchor; ++subpt) {
+                fitted[subpt] = leftfit + static_cast<Accumulate_>(op.interpolation[subpt]) * ydiff;
+            }
+        }
+    });
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Precompute the LOWESS smoother as a linear operator, for use in `apply_operator()`.
+ * This is only valid when no robustness iterations are performed, i.e., `Options::iterations = 0`,
+ * in which case the fitted values are a fixed linear function of the y-coordinates.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ *
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * @param windows Precomputed windows around the anchor points, created by calling `define_windows()` with `num_points`, `x` and `opt`.
+ * @param opt Further options.
+ * This should be the same object that is used in `define_windows()`.
+ * Only `Options::weights` and `Options::num_threads` are used here.
+ * An error is raised if `Options::iterations` is not zero or `Options::warm_start` is not `WarmStart::NONE`.
+ *
+ * @return The linear operator for the LOWESS smoother.
+ * This uses the same `Index_` as `windows` and the same `Accumulate_` as `opt`.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+SmoothingOperator<Data_, Index_, Accumulate_> define_operator(
+    const std::size_t num_points,
+    const Data_* const x,
+    const PrecomputedWindows<Data_, Index_>& windows,
+    const Options<Data_, Accumulate_>& opt
+) {
+    if (opt.iterations != 0) {
+        throw std::runtime_error("robustness iterations are not supported in 'define_operator()'");
+    }
+    if (opt.warm_start != WarmStart::NONE) {
+        throw std::runtime_error("warm starts are not supported in 'define_operator()'");
+    }
+
+    SmoothingOperator<Data_, Index_, Accumulate_> output;
+    output.num_points = num_points;
+    if (num_points == 0) {
+        return output;
+    }
+
+    const auto& anchors = windows.anchors;
+    const auto& limits = windows.limits;
+    const auto num_anchors = anchors.size();
+    assert(num_anchors > 0);
+    output.anchors.assign(anchors.begin(), anchors.end());
+
+    sanisizer::resize(output.starts, num_anchors);
+    sanisizer::resize(output.offsets, sanisizer::sum<std::size_t>(num_anchors, 1));
+    output.offsets[0] = 0;
+    for (I<decltype(num_anchors)> s = 0; s < num_anchors; ++s) {
+        output.starts[s] = limits[s].left;
+        output.offsets[s + 1] = sanisizer::sum<std::size_t>(output.offsets[s], limits[s].right - limits[s].left + 1);
+    }
+    sanisizer::resize(output.values, output.offsets.back());
+
+    parallelize(opt.num_threads, num_anchors, [&](const int, const I<decltype(num_anchors)> start, const I<decltype(num_anchors)> length) {
+        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
+            internal::fill_operator_row<Accumulate_>(anchors[s], limits[s], x, opt.weights, output.values.data() + output.offsets[s]);
+        }
+    });
+
+    sanisizer::resize(output.interpolation, num_points);
+    const auto num_anchors_m1 = num_anchors - 1;
+    parallelize(opt.num_threads, num_anchors_m1, [&](const int, const I<decltype(num_anchors_m1)> start, const I<decltype(num_anchors_m1)> length) {
+        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
+            const auto left_anchor = anchors[s];
+            const auto right_anchor = anchors[s + 1];
+            const Accumulate_ xdiff = static_cast<Accumulate_>(x[right_anchor]) - static_cast<Accumulate_>(x[left_anchor]);
+            for (I<decltype(right_anchor)> subpt = left_anchor + 1; subpt < right_anchor; ++subpt) {
+                // Protect against infinite slopes by just taking the average, see fit_trend().
+                output.interpolation[subpt] = (xdiff > 0 ? (static_cast<Accumulate_>(x[subpt]) - static_cast<Accumulate_>(x[left_anchor])) / xdiff : static_cast<Accumulate_>(0.5));
+            }
+        }
+    });
+
+    return output;
+}
+
+/**
+ * Apply the LOWESS smoother to a y-vector, using the linear operator from `define_operator()`.
+ * This is equivalent to (but faster than) calling `compute()` with `Options::iterations = 0`,
+ * as the fitted value for each anchor is obtained by a single dot product with its row of coefficients.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `SmoothingOperator`.
+ * @tparam Accumulate_ Floating-point type for accumulating the dot products and interpolations, see `SmoothingOperator`.
+ *
+ * @param op Linear operator created by `define_operator()`.
+ * @param[in] y Pointer to an array of y-coordinates of length equal to the number of points used in `define_operator()`.
+ * @param[out] fitted Pointer to an output array of the same length as `y`, in which the fitted values are stored.
+ * @param num_threads Number of threads to use.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+void apply_operator(const SmoothingOperator<Data_, Index_, Accumulate_>& op, const Data_* const y, Data_* const fitted, const int num_threads) {
+    if (op.num_points == 0) {
+        return;
+    }
+    internal::apply_operator_anchors(op, y, fitted, num_threads);
+    internal::apply_operator_interpolation(op, fitted, num_threads);
+}
+
+/**
+ * Apply the LOWESS smoother to multiple y-vectors in a column-major matrix, using the linear operator from `define_operator()`.
+ * Parallelization is performed across columns.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `SmoothingOperator`.
+ * @tparam Accumulate_ Floating-point type for accumulating the dot products and interpolations, see `SmoothingOperator`.
+ *
+ * @param op Linear operator created by `define_operator()`.
+ * @param num_columns Number of y-vectors.
+ * @param[in] y Pointer to a column-major array of y-coordinates, where each column corresponds to a y-vector and each row corresponds to a point.
+ * The number of rows should be equal to the number of points used in `define_operator()`.
+ * @param[out] fitted Pointer to a column-major output array of the same dimensions as `y`, in which the fitted values are stored.
+ * @param num_threads Number of threads to use.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+void apply_operator(const SmoothingOperator<Data_, Index_, Accumulate_>& op, const std::size_t num_columns, const Data_* const y, Data_* const fitted, const int num_threads) {
+    if (op.num_points == 0) {
+        return;
+    }
+    parallelize(num_threads, num_columns, [&](const int, const I<decltype(num_columns)> start, const I<decltype(num_columns)> length) {
+        for (I<decltype(start)> c = start, end = start + length; c < end; ++c) {
+            const auto offset = sanisizer::product_unsafe<std::size_t>(c, op.num_points);
+            internal::apply_operator_anchors(op, y + offset, fitted + offset, 1);
+            internal::apply_operator_interpolation(op, fitted + offset, 1);
+        }
+    });
+}
+
+}
+
+#endif
@@ -9,40 +9,98 @@
 
 #include "sanisizer/sanisizer.hpp"
 
+#include "parallelize.hpp"
 #include "utils.hpp"
 
 namespace WeightedLowess {
 
 namespace internal {
 
+/*
+ * Computing the (weighted) median of the absolute deviations. Rather than
+ * sorting all points, we use a selection algorithm to find the first point in
+ * the sorted order where the cumulative weight reaches half the total weight.
+ * If the cumulative weight is exactly equal to half, we average that point
+ * with the next largest value, i.e., the minimum of the remaining points.
+ * The cumulative weights are computed in 'Accumulate_', which may be more
+ * precise than 'Data_' to avoid loss of accuracy across many points.
+ */
 template<typename Data_>
-Data_ compute_mad(
-    const std::size_t num_points, 
-    const Data_* const y, 
-    const Data_* const fitted, 
-    const Data_* const freq_weights, 
-    Data_ total_weight, 
-    std::vector<Data_>& abs_dev,
-    std::vector<std::size_t>& permutation
-) {
-    sanisizer::resize(abs_dev, num_points); // resizing here for safety, even though it would be more performant to resize once outside the robustness loop in fit().
-    for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
-        abs_dev[i] = std::abs(y[i] - fitted[i]);
+Data_ unweighted_median(const std::size_t num_points, std::vector<Data_>& values) {
+    const auto vbegin = values.begin();
+    const auto half = num_points / 2;
+    if (num_points % 2 == 1) {
+        std::nth_element(vbegin, vbegin + half, vbegin + num_points);
+        return values[half];
     }
 
+    // Remember, 'num_points > 0' from fit_trend(), so 'half > 0' here.
+    std::nth_element(vbegin, vbegin + half - 1, vbegin + num_points);
+    const Data_ left = values[half - 1];
+    const Data_ right = *std::min_element(vbegin + half, vbegin + num_points);
+    return left + (right - left) / 2.0; // reduce risk of overflow.
+}
+
+/*
+ * Below this size, we just sort the remaining range and scan it directly.
+ */
+constexpr std::size_t weighted_median_sort_threshold = 32;
+
+template<typename Data_, typename Accumulate_ = Data_>
+Data_ weighted_median(
+    const std::size_t num_points,
+    const std::vector<Data_>& abs_dev,
+    const Data_* const freq_weights,
+    const Accumulate_ halfweight,
+    std::vector<std::size_t>& permutation
+) {
     sanisizer::resize(permutation, num_points);
     std::iota(permutation.begin(), permutation.end(), static_cast<std::size_t>(0));
-    std::sort(permutation.begin(), permutation.end(), [&](std::size_t left, std::size_t right) -> bool { return abs_dev[left] < abs_dev[right]; });
+    const auto pbegin = permutation.begin();
+    auto cmp = [&](std::size_t left, std::size_t right) -> bool { return abs_dev[left] < abs_dev[right]; };
+
+    /* Invariants: all points in [0, lo) are no greater than those in [lo, hi),
+     * which are no greater than those in [hi, num_points). The target lies in
+     * [lo, hi), and 'curweight' is the total weight of the points in [0, lo).
+     */
+    std::size_t lo = 0, hi = num_points;
+    Accumulate_ curweight = 0;
+    while (hi - lo > weighted_median_sort_threshold) {
+        const auto mid = lo + (hi - lo) / 2;
+        std::nth_element(pbegin + lo, pbegin + mid, pbegin + hi, cmp);
+
+        Accumulate_ leftweight = 0;
+        for (auto i = lo; i < mid; ++i) {
+            leftweight += freq_weights[permutation[i]];
+        }
 
-    Data_ curweight = 0;
-    const Data_ halfweight = total_weight / 2;
-    for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
+        if (curweight + leftweight >= halfweight) {
+            // Equality still means that the target is at 'mid - 1', as this
+            // is the first position where the cumulative weight reaches half.
+            hi = mid;
+        } else {
+            lo = mid;
+            curweight += leftweight;
+        }
+    }
+
+    std::sort(pbegin + lo, pbegin + hi, cmp);
+    for (auto i = lo; i < hi; ++i) {
         const auto pt = permutation[i];
-        curweight += (freq_weights != NULL ? freq_weights[pt] : 1);
+        curweight += freq_weights[pt];
 
         if (curweight == halfweight) { 
-            const auto next_pt = permutation[i + 1]; // increment is safe as 'i + 1 <= num_points'.
-            return abs_dev[pt] + (abs_dev[next_pt] - abs_dev[pt]) / 2.0; // reduce risk of overflow.
+            const auto next = i + 1;
+            if (next < hi) {
+                return abs_dev[pt] + (abs_dev[permutation[next]] - abs_dev[pt]) / 2.0; // reduce risk of overflow.
+            }
+            if (next == num_points) {
+                return abs_dev[pt];
+            }
+
+            // Everything in [hi, num_points) is no less than the element at
+            // 'hi', courtesy of the nth_element() call that set 'hi'.
+            return abs_dev[pt] + (abs_dev[permutation[hi]] - abs_dev[pt]) / 2.0;
         } else if (curweight > halfweight) {
             return abs_dev[pt];
         }
@@ -51,6 +109,38 @@ Data_ compute_mad(
     return 0;
 }
 
+template<typename Data_, typename Accumulate_ = Data_>
+Data_ compute_mad(
+    const std::size_t num_points, 
+    const Data_* const y, 
+    const Data_* const fitted, 
+    const Data_* const freq_weights, 
+    const Data_ total_weight, 
+    std::vector<Data_>& abs_dev,
+    std::vector<Data_>& values,
+    std::vector<std::size_t>& permutation,
+    const int num_threads = 1
+) {
+    sanisizer::resize(abs_dev, num_points); // resizing here for safety, even though it would be more performant to resize once outside the robustness loop in fit().
+    parallelize(num_threads, num_points, [&](const int, const I<decltype(num_points)> start, const I<decltype(num_points)> length) {
+        for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+            abs_dev[i] = std::abs(y[i] - fitted[i]);
+        }
+    });
+
+    if (num_points == 0) {
+        return 0;
+    }
+
+    if (freq_weights != NULL) {
+        return weighted_median(num_points, abs_dev, freq_weights, static_cast<Accumulate_>(total_weight) / 2, permutation);
+    } else {
+        sanisizer::resize(values, num_points);
+        std::copy(abs_dev.begin(), abs_dev.end(), values.begin());
+        return unweighted_median(num_points, values);
+    }
+}
+
 template<typename Data_>
 Data_ compute_robust_range(const std::size_t num_points, const Data_* const y, const Data_* const robust_weights) {
     Data_ first = 0;
@@ -80,6 +170,15 @@ Data_ square (const Data_ x) {
     return x * x;
 }
 
+template<typename Data_>
+Data_ max_abs_diff(const std::size_t num_points, const Data_* const first, const Data_* const second) {
+    Data_ output = 0;
+    for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
+        output = std::max(output, std::abs(first[i] - second[i]));
+    }
+    return output;
+}
+
 template<typename Data_>
 void populate_robust_weights(const std::vector<Data_>& abs_dev, const Data_ threshold, Data_* const robust_weights) {
     const auto num_points = abs_dev.size();
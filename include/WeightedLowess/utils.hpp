@@ -2,6 +2,11 @@
 #define WEIGHTEDLOWESS_UTILS_HPP
 
 #include <type_traits>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+
+#include "sanisizer/sanisizer.hpp"
 
 namespace WeightedLowess {
 
@@ -10,6 +15,40 @@ namespace WeightedLowess {
 template<typename Input_>
 using I = typename std::remove_cv<typename std::remove_reference<Input_>::type>::type;
 
+/**
+ * @cond
+ */
+namespace internal {
+
+template<typename Data_>
+Data_ cube(Data_ x) {
+    return x * x * x;
+}
+
+template<typename Data_>
+Data_ tricube(const Data_ dx, const Data_ dist) {
+    return cube(static_cast<Data_>(1) - cube(std::abs(dx) / dist));
+}
+
+/*
+ * Splitting '[0, num)' into contiguous chunks, one per thread. This is used
+ * instead of parallelize()'s own partitioning when we need to process the
+ * same chunks in multiple passes or stitch their results together in order.
+ */
+inline std::size_t count_chunks(const std::size_t num, const int num_threads) {
+    return std::min(num, sanisizer::cast<std::size_t>(std::max(num_threads, 1)));
+}
+
+inline std::size_t chunk_start(const std::size_t num, const std::size_t num_chunks, const std::size_t c) {
+    const auto chunk_size = num / num_chunks + (num % num_chunks > 0);
+    return std::min(num, chunk_size * c);
+}
+
+}
+/**
+ * @endcond
+ */
+
 }
 
 #endif
@@ -7,6 +7,9 @@
 #include <stdexcept>
 #include <cassert>
 #include <optional>
+#include <cmath>
+#include <limits>
+#include <type_traits>
 
 #include "sanisizer/sanisizer.hpp"
 
@@ -24,8 +27,221 @@ namespace WeightedLowess {
 /**
  * @cond
  */
+template<typename Data_, typename Index_>
+struct Workspace;
+
 namespace internal {
 
+/*
+ * Compensated (Neumaier) summation, so that the total is (almost always) the
+ * correctly rounded sum of the values, regardless of the order in which they
+ * are added or how they are split into blocks.
+ */
+template<typename Data_>
+struct CompensatedSum {
+    Data_ sum = 0, compensation = 0;
+
+    void add(const Data_ val) {
+        const Data_ tmp = sum + val;
+        if (std::abs(sum) >= std::abs(val)) {
+            compensation += (sum - tmp) + val;
+        } else {
+            compensation += (val - tmp) + sum;
+        }
+        sum = tmp;
+    }
+
+    Data_ get() const {
+        return sum + compensation;
+    }
+};
+
+/*
+ * Summing an array in parallel. The array is split into blocks of fixed size,
+ * each block is summed separately and the block sums are then added in order.
+ * This ensures that the result does not depend on the number of threads.
+ */
+constexpr std::size_t sum_block_size = 65536;
+
+template<typename Data_>
+CompensatedSum<Data_> parallel_compensated_sum(const std::size_t num, const Data_* const values, const int num_threads, std::vector<CompensatedSum<Data_> >& block_sums) {
+    const auto num_blocks = num / sum_block_size + (num % sum_block_size > 0);
+    auto sum_block = [&](const std::size_t first, const std::size_t last, CompensatedSum<Data_>& store) -> void {
+        for (auto i = first; i < last; ++i) {
+            store.add(values[i]);
+        }
+    };
+
+    if (num_blocks <= 1) {
+        CompensatedSum<Data_> total;
+        sum_block(0, num, total);
+        return total;
+    }
+
+    sanisizer::resize(block_sums, num_blocks);
+    parallelize(num_threads, num_blocks, [&](const int, const I<decltype(num_blocks)> start, const I<decltype(num_blocks)> length) {
+        for (I<decltype(start)> b = start, end = start + length; b < end; ++b) {
+            const auto first = b * sum_block_size;
+            block_sums[b] = CompensatedSum<Data_>(); // clearing any sums from previous calls.
+            sum_block(first, std::min(num, first + sum_block_size), block_sums[b]);
+        }
+    });
+
+    CompensatedSum<Data_> total;
+    for (const auto& block : block_sums) {
+        total.add(block.sum);
+        total.add(block.compensation);
+    }
+    return total;
+}
+
+template<typename Data_>
+CompensatedSum<Data_> parallel_compensated_sum(const std::size_t num, const Data_* const values, const int num_threads) {
+    std::vector<CompensatedSum<Data_> > block_sums;
+    return parallel_compensated_sum(num, values, num_threads, block_sums);
+}
+
+template<typename Data_>
+Data_ parallel_sum(const std::size_t num, const Data_* const values, const int num_threads, std::vector<CompensatedSum<Data_> >& block_sums) {
+    return parallel_compensated_sum(num, values, num_threads, block_sums).get();
+}
+
+template<typename Data_>
+Data_ parallel_sum(const std::size_t num, const Data_* const values, const int num_threads) {
+    return parallel_compensated_sum(num, values, num_threads).get();
+}
+
+/*
+ * Partitioning '[0, num_tasks)' into contiguous ranges, one per thread, such
+ * that each range has roughly the same total cost. This is used instead of
+ * parallelize()'s equal-sized ranges when the cost of each task is known in
+ * advance and varies greatly between tasks, e.g., fitting windows of different
+ * sizes. On output, 'boundaries' contains the start of each range, plus the end
+ * of the last range.
+ */
+template<class Cost_>
+void partition_by_cost(const std::size_t num_tasks, const int num_threads, Cost_ cost, std::vector<std::size_t>& boundaries) {
+    const auto num_parts = std::max(count_chunks(num_tasks, num_threads), static_cast<std::size_t>(1));
+    sanisizer::resize(boundaries, num_parts + 1);
+    boundaries[0] = 0;
+    boundaries[num_parts] = num_tasks;
+    if (num_parts == 1) {
+        return;
+    }
+
+    // Using a double to avoid overflow when computing the targets.
+    double total = 0;
+    for (std::size_t i = 0; i < num_tasks; ++i) {
+        total += cost(i);
+    }
+
+    // Each range ends at the task whose midpoint crosses the target, so that
+    // a single expensive task is not lumped in with all of its predecessors.
+    double cumulative = 0;
+    std::size_t part = 1;
+    for (std::size_t i = 0; i < num_tasks && part < num_parts; ++i) {
+        const double current = cost(i);
+        while (part < num_parts && cumulative + current / 2 > total * part / num_parts) {
+            boundaries[part] = i;
+            ++part;
+        }
+        cumulative += current;
+    }
+    for (; part < num_parts; ++part) {
+        boundaries[part] = num_tasks;
+    }
+}
+
+template<class Run_>
+void parallelize_partition(const int num_threads, const std::vector<std::size_t>& boundaries, Run_ run) {
+    const auto num_parts = boundaries.size() - 1;
+    if (num_parts == 1) {
+        run(boundaries[0], boundaries[1]);
+        return;
+    }
+
+    parallelize(num_threads, num_parts, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto p = start, end = start + length; p < end; ++p) {
+            run(boundaries[p], boundaries[p + 1]);
+        }
+    });
+}
+
+/*
+ * Parallelizing over points that are grouped into contiguous segments, where
+ * segment 's' contains the points in '[boundary(s), boundary(s + 1))'. Each
+ * thread gets the same number of points and may start or end in the middle of
+ * a segment, which is more even than parallelizing over segments when the
+ * points are concentrated in a few segments. 'run(s, first, last)' is called
+ * for the points in '[first, last)' belonging to segment 's' in each thread.
+ */
+template<class Boundary_, class Run_>
+void parallelize_segments(const std::size_t num_segments, Boundary_ boundary, const int num_threads, Run_ run) {
+    const std::size_t first_point = boundary(0);
+    const std::size_t num_points = static_cast<std::size_t>(boundary(num_segments)) - first_point;
+
+    auto run_range = [&](std::size_t first, const std::size_t last) -> void {
+        // Finding the segment containing 'first', i.e., the last segment that starts at or before 'first'.
+        // Empty segments are skipped as the upper bound will always place us in the last of a tied run of boundaries.
+        std::size_t lo = 0, hi = num_segments;
+        while (lo < hi) {
+            const auto mid = lo + (hi - lo) / 2;
+            if (static_cast<std::size_t>(boundary(mid + 1)) <= first) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        for (auto s = lo; first < last; ++s) {
+            const auto seg_end = std::min(static_cast<std::size_t>(boundary(s + 1)), last);
+            if (seg_end > first) {
+                run(s, first, seg_end);
+                first = seg_end;
+            }
+        }
+    };
+
+    const auto num_chunks = count_chunks(num_points, num_threads);
+    if (num_chunks <= 1) {
+        run_range(first_point, first_point + num_points);
+        return;
+    }
+
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            run_range(first_point + chunk_start(num_points, num_chunks, c), first_point + chunk_start(num_points, num_chunks, c + 1));
+        }
+    });
+}
+
+template<typename Data_>
+bool parallel_is_sorted(const std::size_t num_points, const Data_* const x, const int num_threads, std::vector<unsigned char>& sorted) {
+    if (num_points < 2) {
+        return true;
+    }
+
+    // Each chunk checks the comparisons between its points and the next point, so chunks overlap by one point.
+    const auto num_comparisons = num_points - 1;
+    const auto num_chunks = count_chunks(num_comparisons, num_threads);
+    sanisizer::resize(sorted, num_chunks);
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = chunk_start(num_comparisons, num_chunks, c);
+            const auto last = chunk_start(num_comparisons, num_chunks, c + 1);
+            sorted[c] = std::is_sorted(x + first, x + last + 1);
+        }
+    });
+
+    return std::all_of(sorted.begin(), sorted.end(), [](const unsigned char val) -> bool { return val; });
+}
+
+template<typename Data_>
+bool parallel_is_sorted(const std::size_t num_points, const Data_* const x, const int num_threads) {
+    std::vector<unsigned char> sorted;
+    return parallel_is_sorted(num_points, x, num_threads, sorted);
+}
+
 /* 
  * Determining the `delta`. For a anchor point with x-coordinate `x`, we skip all
  * points in `[x, x + delta]` before finding the next anchor point. 
@@ -43,30 +259,156 @@ namespace internal {
  * degree of approximation in the final lowess calculation).
  */
 template<typename Data_>
-Data_ derive_delta(const std::size_t num_anchors, const std::size_t num_points, const Data_* const x) {
+Data_ derive_delta(
+    const std::size_t num_anchors,
+    const std::size_t num_points,
+    const Data_* const x,
+    std::vector<Data_>& diffs,
+    const int num_threads,
+    std::vector<CompensatedSum<Data_> >& block_sums)
+{
     assert(num_points > 0);
 
     const auto points_m1 = num_points - 1;
-    auto diffs = sanisizer::create<std::vector<Data_> >(points_m1);
-    for (I<decltype(points_m1)> i = 0; i < points_m1; ++i) {
-        diffs[i] = x[i + 1] - x[i];
+    sanisizer::resize(diffs, points_m1);
+    parallelize(num_threads, points_m1, [&](const int, const I<decltype(points_m1)> start, const I<decltype(points_m1)> length) {
+        for (I<decltype(start)> i = start, end = start + length; i < end; ++i) {
+            diffs[i] = x[i + 1] - x[i];
+        }
+    });
+
+    /* We only need the sum of all gaps and the largest 'num_anchors - 1' gaps,
+     * so there's no need to sort everything. We partially sort the largest
+     * gaps to the end and sum all the other gaps directly. The cumulative sum
+     * of the sorted largest gaps then gives us the total of all gaps after
+     * skipping any number of the largest gaps.
+     *
+     * The other gaps are left in an arbitrary order by the partial sort, so
+     * we use compensated summation to obtain a total that does not depend on
+     * the order (or the number of threads). This means that 'delta' may
+     * differ by a few ulps from a naive cumulative sum of the fully sorted
+     * gaps, which can shift the anchors for quantized 'x' where the distances
+     * between points are exact multiples of 'delta'.
+     */
+    const auto max_skips = (num_anchors > 1 ? sanisizer::min(num_anchors - 1, points_m1) : static_cast<std::size_t>(0));
+    const auto num_kept = points_m1 - max_skips;
+    std::nth_element(diffs.begin(), diffs.begin() + num_kept, diffs.end());
+    std::sort(diffs.begin() + num_kept, diffs.end());
+
+    auto cumulative = parallel_compensated_sum(num_kept, diffs.data(), num_threads, block_sums);
+    Data_ lowest_delta = std::numeric_limits<Data_>::infinity();
+    for (I<decltype(max_skips)> i = 0; i < max_skips; ++i) {
+        cumulative.add(diffs[num_kept + i]);
+        const auto nskips = max_skips - i - 1;
+        const Data_ candidate_delta = cumulative.get() / (num_anchors - nskips);
+        lowest_delta = std::min(candidate_delta, lowest_delta);
+    }
+
+    return std::min(cumulative.get(), lowest_delta);
+}
+
+template<typename Data_>
+Data_ derive_delta(const std::size_t num_anchors, const std::size_t num_points, const Data_* const x, std::vector<Data_>& diffs, const int num_threads = 1) {
+    std::vector<CompensatedSum<Data_> > block_sums;
+    return derive_delta(num_anchors, num_points, x, diffs, num_threads, block_sums);
+}
+
+template<typename Data_>
+Data_ derive_delta(const std::size_t num_anchors, const std::size_t num_points, const Data_* const x) {
+    std::vector<Data_> diffs;
+    return derive_delta(num_anchors, num_points, x, diffs);
+}
+
+/*
+ * Run-length index of tied x-coordinates. For each point, we store the
+ * identity of its run of tied values, and for each run, we store the index of
+ * its first point. This allows us to jump to either end of a run in constant
+ * time, rather than walking through all of its points. The index is left empty
+ * if there are no ties, in which case all callers step through points one at a
+ * time; this is also correct (albeit slower) for tied 'x'.
+ */
+template<typename Index_ = std::size_t>
+struct TieIndex {
+    std::vector<Index_> run_ids;
+    std::vector<Index_> run_starts; // has an extra element at the end, equal to the number of points.
+};
+
+template<typename Data_, typename Index_>
+void build_tie_index(const std::size_t num_points, const Data_* const x, TieIndex<Index_>& ties, const int num_threads, std::vector<std::size_t>& run_offsets) {
+    ties.run_ids.clear();
+    ties.run_starts.clear();
+    if (num_points == 0) {
+        return;
     }
 
-    std::sort(diffs.begin(), diffs.end());
-    for (I<decltype(points_m1)> i = 1; i < points_m1; ++i) {
-        diffs[i] += diffs[i-1];            
+    // First pass counts the number of runs starting in each chunk.
+    const auto num_chunks = count_chunks(num_points, num_threads);
+    sanisizer::resize(run_offsets, sanisizer::sum<std::size_t>(num_chunks, 1));
+    run_offsets[0] = 0;
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = chunk_start(num_points, num_chunks, c);
+            const auto last = chunk_start(num_points, num_chunks, c + 1);
+            std::size_t count = 0;
+            for (auto i = first; i < last; ++i) {
+                count += (i == 0 || x[i] != x[i - 1]);
+            }
+            run_offsets[c + 1] = count;
+        }
+    });
+
+    for (std::size_t c = 0; c < num_chunks; ++c) {
+        run_offsets[c + 1] += run_offsets[c];
+    }
+    const auto num_runs = run_offsets.back();
+    if (num_runs == num_points) { // no ties.
+        return;
     }
 
-    Data_ lowest_delta = diffs.back();
-    if (num_anchors > 1) {
-        auto max_skips = sanisizer::min(num_anchors - 1, points_m1);
-        for (I<decltype(max_skips)> nskips = 0; nskips < max_skips; ++nskips) {
-            Data_ candidate_delta = diffs[points_m1 - nskips - 1] / (num_anchors - nskips);
-            lowest_delta = std::min(candidate_delta, lowest_delta);
+    // Second pass fills in the run identities and starts.
+    sanisizer::resize(ties.run_ids, num_points);
+    sanisizer::resize(ties.run_starts, num_runs + 1);
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = chunk_start(num_points, num_chunks, c);
+            const auto last = chunk_start(num_points, num_chunks, c + 1);
+            auto run = run_offsets[c]; // one past the current run, as we haven't seen the start of the first run yet.
+            for (auto i = first; i < last; ++i) {
+                if (i == 0 || x[i] != x[i - 1]) {
+                    ties.run_starts[run] = i;
+                    ++run;
+                }
+                ties.run_ids[i] = run - 1;
+            }
         }
+    });
+    ties.run_starts[num_runs] = num_points;
+}
+
+template<typename Data_, typename Index_>
+void build_tie_index(const std::size_t num_points, const Data_* const x, TieIndex<Index_>& ties, const int num_threads = 1) {
+    std::vector<std::size_t> run_offsets;
+    build_tie_index(num_points, x, ties, num_threads, run_offsets);
+}
+
+// First point in the run containing 'i'.
+template<typename Index_>
+std::size_t run_first(const TieIndex<Index_>& ties, const std::size_t i) {
+    if (ties.run_ids.empty()) {
+        return i;
+    } else {
+        return ties.run_starts[ties.run_ids[i]];
     }
+}
 
-    return lowest_delta;
+// Last point in the run containing 'i'.
+template<typename Index_>
+std::size_t run_last(const TieIndex<Index_>& ties, const std::size_t i) {
+    if (ties.run_ids.empty()) {
+        return i;
+    } else {
+        return ties.run_starts[ties.run_ids[i] + 1] - 1;
+    }
 }
 
 /* 
@@ -77,19 +419,130 @@ Data_ derive_delta(const std::size_t num_anchors, const std::size_t num_points,
  * We start at the first point (so it is always an anchor) and we do this
  * skipping up to but not including the last point; the last point itself is
  * always included as an anchor to ensure we have exactness at the ends.
+ *
+ * The next anchor is found by a galloping search from the current anchor, so
+ * the cost depends on the number of anchors rather than the number of points.
+ * This also skips over runs of tied points.
  */
 template<typename Data_>
-void find_anchors(const std::size_t num_points, const Data_* x, Data_ delta, std::vector<std::size_t>& anchors) {
+std::size_t next_anchor(const Data_* const x, const std::size_t last_pt, const std::size_t pos, const std::size_t end, const Data_ delta) {
+    auto within = [&](const Data_ val) -> bool { return val - x[last_pt] <= delta; };
+    if (pos >= end || !within(x[pos])) {
+        return pos;
+    }
+
+    std::size_t lo = pos, step = 1, hi;
+    while (1) {
+        if (end - lo <= step) {
+            hi = end;
+            break;
+        }
+        hi = lo + step;
+        if (!within(x[hi])) {
+            break;
+        }
+        lo = hi;
+        step *= 2;
+    }
+
+    return std::partition_point(x + lo + 1, x + hi, within) - x;
+}
+
+template<typename Data_, class Store_>
+void find_anchor_chain(const Data_* const x, std::size_t last_pt, std::size_t pos, const std::size_t end, const Data_ delta, Store_ store) {
+    while (1) {
+        pos = next_anchor(x, last_pt, pos, end, delta);
+        if (pos >= end) {
+            break;
+        }
+        store(pos);
+        last_pt = pos;
+        ++pos;
+    }
+}
+
+/*
+ * For parallelization, we split the candidate points into chunks. In each
+ * chunk, we speculatively assume that the first point is an anchor and find
+ * the subsequent chain of anchors. We then stitch the chunks together in
+ * order: given the last true anchor from the previous chunks, we find the
+ * first true anchor in the current chunk and follow the true chain until it
+ * coalesces with the speculative chain. As each anchor only depends on the
+ * previous anchor, the rest of the speculative chain must be correct.
+ *
+ * Each speculative chain contains at most one anchor per candidate in its
+ * chunk, so it is stored in the chunk's own slice of 'speculative'. This
+ * avoids any allocations inside the parallel section.
+ */
+template<typename Data_, typename Index_>
+void find_anchors(
+    const std::size_t num_points,
+    const Data_* x,
+    Data_ delta,
+    std::vector<Index_>& anchors,
+    const int num_threads,
+    std::vector<Index_>& speculative,
+    std::vector<std::size_t>& chain_lengths)
+{
     assert(num_points > 0);
     anchors.clear();
     anchors.push_back(0);
 
-    std::size_t last_pt = 0;
     const std::size_t points_m1 = num_points - 1;
-    for (I<decltype(points_m1)> pt = 1; pt < points_m1; ++pt) {
-        if (x[pt] - x[last_pt] > delta) {
-            anchors.push_back(pt);
-            last_pt = pt;
+    const std::size_t num_candidates = (points_m1 > 1 ? points_m1 - 1 : 0); // candidates lie in [1, points_m1).
+    const auto num_chunks = count_chunks(num_candidates, num_threads);
+
+    if (num_chunks <= 1) {
+        find_anchor_chain(x, static_cast<std::size_t>(0), static_cast<std::size_t>(1), points_m1, delta, [&](const std::size_t pos) -> void { anchors.push_back(pos); });
+        anchors.push_back(points_m1);
+        return;
+    }
+
+    sanisizer::resize(speculative, num_candidates);
+    sanisizer::resize(chain_lengths, num_chunks);
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = chunk_start(num_candidates, num_chunks, c) + 1;
+            const auto last = chunk_start(num_candidates, num_chunks, c + 1) + 1;
+            chain_lengths[c] = 0;
+            if (first >= last) {
+                continue;
+            }
+
+            const auto current = speculative.data() + (first - 1);
+            std::size_t count = 0;
+            auto store = [&](const std::size_t pos) -> void {
+                current[count] = pos;
+                ++count;
+            };
+            store(first);
+            find_anchor_chain(x, first, first + 1, last, delta, store);
+            chain_lengths[c] = count;
+        }
+    });
+
+    for (std::size_t c = 0; c < num_chunks; ++c) {
+        const auto first = chunk_start(num_candidates, num_chunks, c) + 1;
+        const auto last = chunk_start(num_candidates, num_chunks, c + 1) + 1;
+        const auto current_begin = speculative.begin() + (first - 1);
+        const auto current_end = current_begin + chain_lengths[c];
+        auto cIt = current_begin;
+
+        auto pos = first;
+        while (1) {
+            pos = next_anchor(x, anchors.back(), pos, last, delta);
+            if (pos >= last) {
+                break;
+            }
+
+            cIt = std::lower_bound(cIt, current_end, pos);
+            if (cIt != current_end && *cIt == pos) {
+                anchors.insert(anchors.end(), cIt, current_end);
+                break;
+            }
+
+            anchors.push_back(pos);
+            ++pos;
         }
     }
 
@@ -97,12 +550,76 @@ void find_anchors(const std::size_t num_points, const Data_* x, Data_ delta, std
     return;
 }
 
-template<typename Data_>
+template<typename Data_, typename Index_>
+void find_anchors(const std::size_t num_points, const Data_* x, Data_ delta, std::vector<Index_>& anchors, const int num_threads = 1) {
+    std::vector<Index_> speculative;
+    std::vector<std::size_t> chain_lengths;
+    find_anchors(num_points, x, delta, anchors, num_threads, speculative, chain_lengths);
+}
+
+template<typename Data_, typename Index_ = std::size_t>
 struct Window {
-    std::size_t left, right;
+    Index_ left, right;
     Data_ distance;
 };
 
+/* 
+ * Stretching a window to include all ties at its ends, and then extending it
+ * to satisfy the minimum width, if necessary. This is shared by all methods
+ * for finding the window boundaries.
+ */
+template<typename Data_, typename Index_>
+Window<Data_, Index_> finalize_window(
+    const Data_ curx,
+    std::size_t left,
+    std::size_t right,
+    const std::size_t num_points,
+    const Data_* const x, 
+    const TieIndex<Index_>& ties,
+    const Data_ half_min_width)
+{
+    const auto points_m1 = num_points - 1;
+
+    /* Once we've found the span, we stretch it out to include all ties. */
+    if (!ties.run_ids.empty()) {
+        left = run_first(ties, left);
+        right = run_last(ties, right);
+    } else {
+        while (left > 0 && x[left] == x[left - 1]) {
+            --left; 
+        }
+        while (right < points_m1 && x[right] == x[right + 1]) { 
+            ++right; 
+        }
+    }
+
+    /* Forcibly extending the span if it fails the min width.  We use
+     * the existing 'left' and 'right' to truncate the search space.
+     */
+    auto mdist = std::max(curx - x[left], x[right] - curx);
+    if (mdist < half_min_width) {
+        left = std::lower_bound(x, x + left, curx - half_min_width) - x; 
+
+        /* 'right' still refers to a point inside the window, and we
+         * already know that the window is too small, so we shift it
+         * forward by one to start searching outside. However,
+         * upper_bound gives us the first element that is _outside_ the
+         * window, so we need to subtract one to get to the last
+         * element _inside_ the window.
+         */
+        right = std::upper_bound(x + right + 1, x + num_points, curx + half_min_width) - x;
+        --right;
+
+        mdist = std::max(curx - x[left], x[right] - curx);
+    }
+
+    Window<Data_, Index_> output;
+    output.left = left;
+    output.right = right;
+    output.distance = mdist;
+    return output;
+}
+
 /* This function identifies the start and end index in the span for each chosen sampling
  * point. It returns two arrays via reference containing said indices. It also returns
  * an array containing the maximum distance between points at each span.
@@ -112,30 +629,53 @@ struct Window {
  * amenable to updating through cycles of addition and subtraction. At any rate, the
  * algorithm as a whole remains quadratic (as weights must be recomputed) so there's no
  * damage to scalability.
+ *
+ * For unweighted data, see slide_limits() instead.
  */
-template<typename Data_>
-std::vector<Window<Data_> > find_limits(
-    const std::vector<std::size_t>& anchors, 
+template<bool Weighted_, typename Data_>
+Data_ point_weight(const Data_* const weights, const std::size_t i) {
+    if constexpr(Weighted_) {
+        return weights[i];
+    } else {
+        return 1;
+    }
+}
+
+template<bool Weighted_, typename Data_, typename Index_>
+void expand_limits(
+    const std::vector<Index_>& anchors, 
     const Data_ span_weight,
     const std::size_t num_points,
     const Data_* const x, 
     const Data_* const weights,
+    const TieIndex<Index_>& ties,
     const Data_ min_width,
-    int nthreads = 1)
+    const int nthreads,
+    std::vector<Window<Data_, Index_> >& limits,
+    std::vector<std::size_t>& boundaries)
 {
     const auto nanchors = anchors.size();
-    auto limits = sanisizer::create<std::vector<Window<Data_> > >(nanchors);
     const auto half_min_width = min_width / 2;
 
     assert(num_points > 0);
     const auto points_m1 = num_points - 1;
 
-    parallelize(nthreads, nanchors, [&](const int, const I<decltype(nanchors)> start, const I<decltype(nanchors)> length) {
-        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
+    // As in slide_limits(), we balance the anchors between threads by their
+    // spacing, so that each thread is responsible for a similar stretch of points.
+    partition_by_cost(nanchors, nthreads, [&](const std::size_t s) -> std::size_t { return (s + 1 < nanchors ? anchors[s + 1] - anchors[s] : 1); }, boundaries);
+
+    parallelize_partition(nthreads, boundaries, [&](const std::size_t start, const std::size_t end) {
+        for (auto s = start; s < end; ++s) {
             const auto curpt = anchors[s];
             const auto curx = x[curpt];
+
+            // Tied anchors always have the same windows, so we can just copy them.
+            if (s > start && x[anchors[s - 1]] == curx) {
+                limits[s] = limits[s - 1];
+                continue;
+            }
             auto left = curpt, right = curpt;
-            Data_ curw = (weights == NULL ? 1 : weights[curpt]);
+            Data_ curw = point_weight<Weighted_>(weights, curpt);
 
             // First expanding in both directions, choosing the one that
             // minimizes the increase in the window size.
@@ -146,7 +686,7 @@ std::vector<Window<Data_> > find_limits(
                 while (curw < span_weight) {
                     if (next_ldist < next_rdist) {
                         --left;
-                        curw += (weights == NULL ? 1 : weights[left]);
+                        curw += point_weight<Weighted_>(weights, left);
                         if (left == 0) {
                             break;
                         }
@@ -154,7 +694,7 @@ std::vector<Window<Data_> > find_limits(
 
                     } else if (next_ldist > next_rdist) {
                         ++right;
-                        curw += (weights == NULL ? 1 : weights[right]);
+                        curw += point_weight<Weighted_>(weights, right);
                         if (right == points_m1) {
                             break;
                         }
@@ -166,7 +706,7 @@ std::vector<Window<Data_> > find_limits(
                         // included.  Otherwise one of them is skipped if we break.
                         --left;
                         ++right;
-                        curw += (weights == NULL ? 2 : weights[left] + weights[right]);
+                        curw += point_weight<Weighted_>(weights, left) + point_weight<Weighted_>(weights, right);
                         if (left == 0 || right == points_m1) {
                             break;
                         }
@@ -179,52 +719,444 @@ std::vector<Window<Data_> > find_limits(
             // If we still need it, we expand in only one direction.
             while (left > 0 && curw < span_weight) {
                 --left;
-                curw += (weights == NULL ? 1 : weights[left]);
+                curw += point_weight<Weighted_>(weights, left);
             }
      
             while (right < points_m1 && curw < span_weight) {
                 ++right;
-                curw += (weights == NULL ? 1 : weights[right]);
+                curw += point_weight<Weighted_>(weights, right);
+            }
+
+            limits[s] = finalize_window(curx, left, right, num_points, x, ties, half_min_width);
+        }
+    });
+}
+
+/* 
+ * Without weights, the expansion in expand_limits() is equivalent to taking
+ * the 'N' nearest neighbors of each anchor, where 'N' is the span rounded up
+ * to the nearest integer. These neighbors always form a contiguous interval of
+ * points, and the start of this interval can only move forward as the anchor
+ * moves forward. So, we can find all windows with a single sweep of a sliding
+ * window of 'N' points, which is linear in the number of points.
+ *
+ * To reproduce the results of the expansion exactly, we need to consider the
+ * points at the N-th smallest distance 'D'. All points with distances less than
+ * 'D' are always included. Of the points at 'D', the expansion takes pairs of
+ * points from both sides until 'N' is reached, and then takes single points
+ * from whichever side still has points at 'D'.
+ */
+template<typename Data_>
+std::size_t count_span_points(const Data_ span_weight, const std::size_t num_points) {
+    if (!(span_weight > 1)) { // also catches NaNs.
+        return 1;
+    } else if (span_weight >= static_cast<Data_>(num_points)) {
+        return num_points;
+    } else {
+        return std::min(num_points, sanisizer::cast<std::size_t>(std::ceil(span_weight)));
+    }
+}
+
+template<typename Data_, typename Index_>
+void slide_limits(
+    const std::vector<Index_>& anchors, 
+    const Data_ span_weight,
+    const std::size_t num_points,
+    const Data_* const x, 
+    const TieIndex<Index_>& ties,
+    const Data_ min_width,
+    const int nthreads,
+    std::vector<Window<Data_, Index_> >& limits,
+    std::vector<std::size_t>& boundaries)
+{
+    const auto nanchors = anchors.size();
+    const auto half_min_width = min_width / 2;
+
+    assert(num_points > 0);
+    const auto span_points = count_span_points(span_weight, num_points);
+    const auto max_start = num_points - span_points;
+
+    /* The cost of the sweep for each thread is proportional to the number of
+     * points that it slides over, so we balance the anchors by their spacing.
+     * This is more even than giving the same number of anchors to each thread
+     * when the anchors are irregularly spaced, e.g., with a large 'delta'.
+     */
+    partition_by_cost(nanchors, nthreads, [&](const std::size_t s) -> std::size_t { return (s + 1 < nanchors ? anchors[s + 1] - anchors[s] : 1); }, boundaries);
+
+    parallelize_partition(nthreads, boundaries, [&](const std::size_t start, const std::size_t end) {
+        std::size_t wstart = 0;
+
+        for (auto s = start; s < end; ++s) {
+            const auto curpt = anchors[s];
+            const auto curx = x[curpt];
+
+            // Tied anchors always have the same windows, so we can just copy them.
+            if (s > start && x[anchors[s - 1]] == curx) {
+                limits[s] = limits[s - 1];
+                continue;
+            }
+
+            // Sliding the window forward while the point past its end is closer than its start.
+            if (curpt >= span_points) {
+                wstart = std::max(wstart, curpt - span_points + 1);
+            }
+            while (wstart < max_start && x[wstart + span_points] - curx < curx - x[wstart]) {
+                ++wstart;
+            }
+
+            const auto wend = wstart + span_points - 1;
+            const Data_ dist = std::max(curx - x[wstart], x[wend] - curx);
+            if (dist <= 0) {
+                limits[s] = finalize_window(curx, curpt, curpt, num_points, x, ties, half_min_width);
+                continue;
+            }
+
+            // Counting the points at distance 'D' inside the window, on either side.
+            // We jump over runs of ties, as these must have the same distance.
+            std::size_t inner_left = wstart, inner_right = wend;
+            while (curx - x[inner_left] == dist) {
+                inner_left = run_last(ties, inner_left) + 1;
+            }
+            while (x[inner_right] - curx == dist) {
+                inner_right = run_first(ties, inner_right) - 1;
+            }
+            const std::size_t needed = (inner_left - wstart) + (wend - inner_right);
+
+            // Counting the points at distance 'D' on either side, up to 'needed'.
+            std::size_t outer_left = inner_left;
+            while (inner_left - outer_left < needed && outer_left > 0 && curx - x[outer_left - 1] == dist) {
+                outer_left = run_first(ties, outer_left - 1);
+            }
+            const auto num_left = std::min(inner_left - outer_left, needed);
+
+            std::size_t outer_right = inner_right;
+            const auto points_m1 = num_points - 1;
+            while (outer_right - inner_right < needed && outer_right < points_m1 && x[outer_right + 1] - curx == dist) {
+                outer_right = run_last(ties, outer_right + 1);
+            }
+            const auto num_right = std::min(outer_right - inner_right, needed);
+
+            std::size_t take_left, take_right;
+            const auto num_pairs = std::min(num_left, num_right);
+            if (num_pairs * 2 >= needed) {
+                take_left = needed / 2 + needed % 2;
+                take_right = take_left;
+            } else {
+                take_left = num_pairs;
+                take_right = num_pairs;
+                const auto remaining = needed - num_pairs * 2;
+                if (num_left > num_right) {
+                    take_left += remaining;
+                } else {
+                    take_right += remaining;
+                }
+            }
+
+            limits[s] = finalize_window(curx, inner_left - take_left, inner_right + take_right, num_points, x, ties, half_min_width);
+        }
+    });
+}
+
+/*
+ * With frequency weights, we can optionally precompute a prefix sum of the
+ * weights so that the total weight of any interval can be obtained in constant
+ * time. For each anchor, we then find the smallest distance 'D' at which the
+ * total weight of all points within 'D' reaches the span. This is done with a
+ * binary search over the candidate distances on each side of the anchor, where
+ * the weight for each candidate is computed from the extent of the window on
+ * both sides.
+ *
+ * As in slide_limits(), we reproduce the expansion in expand_limits() by
+ * considering the points at distance 'D'. The expansion takes pairs of points
+ * from both sides until the span is reached; if one side runs out, it takes
+ * single points from the other side. Again, we use binary searches to count the
+ * number of pairs and singles.
+ *
+ * The prefix sum is stored in at least double precision and is computed with
+ * compensated summation, to reduce the accumulation of errors across a large
+ * number of points. Nonetheless, the window weights will not be exactly the
+ * same as those in expand_limits() for non-integer weights, so the boundaries
+ * may occasionally differ when the window weight is very close to the span.
+ * This is why the search is only used when requested by the user.
+ */
+template<typename Data_>
+using PrefixWeight = typename std::common_type<Data_, double>::type;
+
+template<typename Data_>
+void compute_prefix_weights(const std::size_t num_points, const Data_* const weights, std::vector<PrefixWeight<Data_> >& prefix) {
+    sanisizer::resize(prefix, sanisizer::sum<std::size_t>(num_points, 1));
+    prefix[0] = 0;
+    CompensatedSum<PrefixWeight<Data_> > sum;
+    for (I<decltype(num_points)> i = 0; i < num_points; ++i) {
+        sum.add(weights[i]);
+        prefix[i + 1] = sum.get();
+    }
+}
+
+/*
+ * Finding the first integer in [lo, hi) for which a monotonic predicate is
+ * true, or 'hi' if there is no such integer.
+ */
+template<typename Predicate_>
+std::size_t find_first(std::size_t lo, std::size_t hi, Predicate_ pred) {
+    while (lo < hi) {
+        const auto mid = lo + (hi - lo) / 2;
+        if (pred(mid)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+template<typename Data_, typename Index_>
+void search_limits(
+    const std::vector<Index_>& anchors, 
+    const Data_ span_weight,
+    const std::size_t num_points,
+    const Data_* const x, 
+    const Data_* const weights,
+    const TieIndex<Index_>& ties,
+    const Data_ min_width,
+    const int nthreads,
+    std::vector<Window<Data_, Index_> >& limits,
+    std::vector<PrefixWeight<Data_> >& prefix)
+{
+    const auto nanchors = anchors.size();
+    const auto half_min_width = min_width / 2;
+
+    assert(num_points > 0);
+    const auto points_m1 = num_points - 1;
+    compute_prefix_weights(num_points, weights, prefix);
+    const auto cumulative = prefix.data();
+
+    parallelize(nthreads, nanchors, [&](const int, const I<decltype(nanchors)> start, const I<decltype(nanchors)> length) {
+        for (I<decltype(start)> s = start, end = start + length; s < end; ++s) {
+            const auto curpt = anchors[s];
+            const auto curx = x[curpt];
+
+            // Tied anchors always have the same windows, so we can just copy them.
+            if (s > start && x[anchors[s - 1]] == curx) {
+                limits[s] = limits[s - 1];
+                continue;
             }
 
-            /* Once we've found the span, we stretch it out to include all ties. */
-            while (left > 0 && x[left] == x[left - 1]) {
-                --left; 
+            // First and last points with distances no greater than 'dist' on either side of the anchor.
+            auto first_within = [&](const Data_ dist) -> std::size_t {
+                return std::partition_point(x, x + curpt, [&](const Data_ val) -> bool { return curx - val > dist; }) - x;
+            };
+            auto last_within = [&](const Data_ dist) -> std::size_t {
+                return std::partition_point(x + curpt + 1, x + num_points, [&](const Data_ val) -> bool { return val - curx <= dist; }) - x - 1;
+            };
+            auto reaches_span = [&](const Data_ dist) -> bool {
+                return cumulative[last_within(dist) + 1] - cumulative[first_within(dist)] >= span_weight;
+            };
+
+            // Finding the smallest distance on each side that reaches the span. 
+            // For the left, we look for the last candidate that reaches the span.
+            const std::size_t left_candidate = std::partition_point(x, x + curpt + 1, [&](const Data_ val) -> bool { return reaches_span(curx - val); }) - x;
+            const std::size_t right_candidate = std::partition_point(x + curpt, x + num_points, [&](const Data_ val) -> bool { return !reaches_span(val - curx); }) - x;
+
+            bool found = false;
+            Data_ dist = 0;
+            if (left_candidate > 0) {
+                found = true;
+                dist = curx - x[left_candidate - 1];
+            }
+            if (right_candidate < num_points) {
+                const Data_ rdist = x[right_candidate] - curx;
+                dist = (found ? std::min(dist, rdist) : rdist);
+                found = true;
             }
 
-            while (right < points_m1 && x[right] == x[right + 1]) { 
-                ++right; 
+            if (!found) { // total weight is less than the span, so we just take everything.
+                limits[s] = finalize_window(curx, static_cast<std::size_t>(0), points_m1, num_points, x, ties, half_min_width);
+                continue;
+            }
+            if (dist <= 0) {
+                limits[s] = finalize_window(curx, curpt, curpt, num_points, x, ties, half_min_width);
+                continue;
             }
 
-            /* Forcibly extending the span if it fails the min width.  We use
-             * the existing 'left' and 'right' to truncate the search space.
-             */
-            auto mdist = std::max(curx - x[left], x[right] - curx);
-            if (mdist < half_min_width) {
-                left = std::lower_bound(x, x + left, curx - half_min_width) - x; 
-
-                /* 'right' still refers to a point inside the window, and we
-                 * already know that the window is too small, so we shift it
-                 * forward by one to start searching outside. However,
-                 * upper_bound gives us the first element that is _outside_ the
-                 * window, so we need to subtract one to get to the last
-                 * element _inside_ the window.
-                 */
-                right = std::upper_bound(x + right + 1, x + num_points, curx + half_min_width) - x;
-                --right;
-
-                mdist = std::max(curx - x[left], x[right] - curx);
+            // Points within '[inner_left, inner_right]' have distances less than 'D'.
+            const auto outer_left = first_within(dist);
+            const auto outer_right = last_within(dist);
+            const std::size_t inner_left = std::partition_point(x + outer_left, x + curpt, [&](const Data_ val) -> bool { return curx - val >= dist; }) - x;
+            const std::size_t inner_right = std::partition_point(x + curpt + 1, x + outer_right + 1, [&](const Data_ val) -> bool { return val - curx < dist; }) - x - 1;
+            const auto num_left = inner_left - outer_left;
+            const auto num_right = outer_right - inner_right;
+            auto window_weight = [&](const std::size_t take_left, const std::size_t take_right) -> PrefixWeight<Data_> {
+                return cumulative[inner_right + take_right + 1] - cumulative[inner_left - take_left];
+            };
+
+            // Counting the pairs that are needed to reach the span.
+            const auto num_pairs = std::min(num_left, num_right);
+            const auto take_pairs = find_first(static_cast<std::size_t>(1), num_pairs + 1, [&](const std::size_t k) -> bool { return window_weight(k, k) >= span_weight; });
+            std::size_t take_left = std::min(take_pairs, num_pairs), take_right = take_left;
+
+            // Adding singles from the side that still has points at 'D'.
+            if (window_weight(take_left, take_right) < span_weight) {
+                if (num_left > take_left) {
+                    take_left = std::min(num_left, find_first(take_left + 1, num_left + 1, [&](const std::size_t k) -> bool { return window_weight(k, take_right) >= span_weight; }));
+                } else if (num_right > take_right) {
+                    take_right = std::min(num_right, find_first(take_right + 1, num_right + 1, [&](const std::size_t k) -> bool { return window_weight(take_left, k) >= span_weight; }));
+                }
             }
 
-            limits[s].left = left;
-            limits[s].right = right;
-            limits[s].distance = mdist;
+            limits[s] = finalize_window(curx, inner_left - take_left, inner_right + take_right, num_points, x, ties, half_min_width);
         }
     });
+}
 
+template<typename Data_, typename Index_>
+void fill_limits(
+    const std::vector<Index_>& anchors, 
+    const Data_ span_weight,
+    const std::size_t num_points,
+    const Data_* const x, 
+    const Data_* const weights,
+    const TieIndex<Index_>& ties,
+    const Data_ min_width,
+    const int nthreads,
+    const bool search,
+    std::vector<Window<Data_, Index_> >& limits,
+    std::vector<PrefixWeight<Data_> >& prefix,
+    std::vector<std::size_t>& boundaries)
+{
+    sanisizer::resize(limits, anchors.size());
+    if (weights != NULL) {
+        if (search) {
+            search_limits(anchors, span_weight, num_points, x, weights, ties, min_width, nthreads, limits, prefix);
+        } else {
+            expand_limits<true>(anchors, span_weight, num_points, x, weights, ties, min_width, nthreads, limits, boundaries);
+        }
+    } else {
+        slide_limits(anchors, span_weight, num_points, x, ties, min_width, nthreads, limits, boundaries);
+    }
+}
+
+template<typename Data_, typename Index_ = std::size_t>
+std::vector<Window<Data_, Index_> > find_limits(
+    const std::vector<Index_>& anchors, 
+    const Data_ span_weight,
+    const std::size_t num_points,
+    const Data_* const x, 
+    const Data_* const weights,
+    const Data_ min_width,
+    int nthreads = 1,
+    const bool search = false)
+{
+    std::vector<Window<Data_, Index_> > limits;
+    std::vector<PrefixWeight<Data_> > prefix;
+    std::vector<std::size_t> boundaries;
+    TieIndex<Index_> ties;
+    build_tie_index(num_points, x, ties, nthreads);
+    fill_limits(anchors, span_weight, num_points, x, weights, ties, min_width, nthreads, search, limits, prefix, boundaries);
     return limits;
 }
 
+}
+/**
+ * @endcond
+ */
+
+/**
+ * @cond
+ */
+namespace internal {
+
+/*
+ * Checking whether 'x' is an equispaced grid, i.e., 'x[i] = x[0] + i * step'
+ * for some positive 'step'. We allow for some round-off error relative to the
+ * magnitude of 'x', as grids are usually generated by repeated addition or by
+ * multiplication of an integer index.
+ */
+template<typename Data_>
+Data_ grid_tolerance(const std::size_t num_points, const Data_* const x) {
+    return std::max(std::abs(x[0]), std::abs(x[num_points - 1])) * std::numeric_limits<Data_>::epsilon() * 64;
+}
+
+template<typename Data_>
+std::optional<Data_> find_grid_step(const std::size_t num_points, const Data_* const x, const int num_threads, std::vector<unsigned char>& regular) {
+    if (num_points < 3) {
+        return std::nullopt;
+    }
+
+    const auto num_steps = num_points - 1;
+    const Data_ step = (x[num_steps] - x[0]) / num_steps;
+    const Data_ tol = grid_tolerance(num_points, x);
+    if (step <= tol) {
+        return std::nullopt;
+    }
+
+    const auto num_chunks = count_chunks(num_points, num_threads);
+    sanisizer::resize(regular, num_chunks);
+    parallelize(num_threads, num_chunks, [&](const int, const std::size_t start, const std::size_t length) {
+        for (auto c = start, end = start + length; c < end; ++c) {
+            const auto first = chunk_start(num_points, num_chunks, c);
+            const auto last = chunk_start(num_points, num_chunks, c + 1);
+            regular[c] = true;
+            for (auto i = first; i < last; ++i) {
+                if (std::abs(x[i] - (x[0] + static_cast<Data_>(i) * step)) > tol) {
+                    regular[c] = false;
+                    break;
+                }
+            }
+        }
+    });
+
+    if (std::all_of(regular.begin(), regular.end(), [](const unsigned char val) -> bool { return val; })) {
+        return step;
+    } else {
+        return std::nullopt;
+    }
+}
+
+template<typename Data_>
+std::optional<Data_> find_grid_step(const std::size_t num_points, const Data_* const x, const int num_threads) {
+    std::vector<unsigned char> regular;
+    return find_grid_step(num_points, x, num_threads, regular);
+}
+
+/*
+ * Tricube weights for a symmetric window of '2 * halfwidth + 1' points on an
+ * equispaced grid. All interior anchors with the same window size and distance
+ * can re-use these weights, such that the local regression is just a
+ * convolution of the stencil with the (weighted) y-values. The 'offsets' are
+ * the x-coordinates relative to the anchor in units of the grid step, which
+ * is fine as the intercept of the local regression does not depend on the
+ * scaling of x. 'halfwidth = 0' indicates that no stencil is available.
+ *
+ * The points at either end of the stencil lie at the window distance and have
+ * zero tricube weight (up to round-off). Due to round-off in 'x', an interior
+ * window may only include one of these end points, so we allow the stencil to
+ * be used for windows that are one point shorter on either side, and for
+ * window distances that are within the grid tolerance. This means that the
+ * stencil only approximates the window-specific fit in fit_point().
+ */
+template<typename Data_, typename Index_>
+struct GridStencil {
+    Index_ halfwidth = 0;
+    Index_ num_points = 0;
+    Data_ distance = 0;
+    Data_ tolerance = 0;
+    std::vector<Data_> weights, offsets;
+    Data_ total_weight = 0;
+};
+
+template<typename Data_, typename Index_>
+bool use_grid_stencil(const GridStencil<Data_, Index_>& stencil, const std::size_t curpt, const Window<Data_, Index_>& limits) {
+    const std::size_t halfwidth = stencil.halfwidth;
+    if (halfwidth == 0 || curpt < halfwidth || stencil.num_points - curpt <= halfwidth) {
+        return false;
+    }
+    const std::size_t nleft = curpt - limits.left, nright = limits.right - curpt;
+    return (nleft == halfwidth || nleft + 1 == halfwidth) &&
+        (nright == halfwidth || nright + 1 == halfwidth) &&
+        std::abs(limits.distance - stencil.distance) <= stencil.tolerance;
+}
+
 }
 /**
  * @endcond
@@ -234,50 +1166,66 @@ std::vector<Window<Data_> > find_limits(
  * @brief Precomputed windows for LOWESS smoothing.
  *
  * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices.
+ * This should be large enough to hold the number of points.
+ * Using a smaller type (e.g., `std::uint32_t`) reduces the memory usage of the windows when many instances are held at once.
  *
  * Instances of this class are typically created by `define_windows()` prior to `compute()`.
  */
-template<typename Data_>
+template<typename Data_, typename Index_ = std::size_t>
 struct PrecomputedWindows {
     /**
      * @cond
      */
-    std::vector<std::size_t> anchors;
+    std::vector<Index_> anchors;
     const Data_* freq_weights = NULL;
     Data_ total_weight = 0;
-    std::vector<internal::Window<Data_> > limits;
+    std::vector<internal::Window<Data_, Index_> > limits;
+    internal::TieIndex<Index_> ties;
+    internal::GridStencil<Data_, Index_> stencil;
     /**
      * @endcond
      */
 };
 
 /**
- * Identify anchor points and precompute the associated windows prior to LOWESS smoothing via `compute()`. 
- * This avoids wasting time in unnecessarily recomputing the same windows for the same `x` but different `y` in multiple `compute()` calls.
- *
- * @tparam Data_ Floating-point type of the data.
- * 
- * @param num_points Number of points.
- * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
- * (Consider using `SortBy` to permute the array in-place before calling this function.)
- * @param opt Further options.
- * Only a subset of options are actually used here, namely
- * `Options::delta`,
- * `Options::anchors`,
- * `Options::weights`,
- * `Options::frequency_weights`,
- * `Options::span`,
- * `Options::span_as_proportion`,
- * and `Options::minimum_width`.
+ * @cond
  */
-template<typename Data_>
-PrecomputedWindows<Data_> define_windows(const std::size_t num_points, const Data_* const x, const Options<Data_>& opt) {
-    PrecomputedWindows<Data_> output;
+namespace internal {
+
+/*
+ * Temporary buffers for define_windows(), which can be re-used across calls
+ * when held in a Workspace.
+ */
+template<typename Data_, typename Index_>
+struct WindowBuffers {
+    std::vector<unsigned char> chunk_flags; // for parallel_is_sorted() and find_grid_step().
+    std::vector<std::size_t> chunk_counts; // for build_tie_index() and find_anchors().
+    std::vector<Index_> speculative; // for find_anchors().
+    std::vector<Data_> diffs; // for derive_delta().
+    std::vector<CompensatedSum<Data_> > block_sums; // for parallel_sum().
+    std::vector<PrefixWeight<Data_> > prefix; // for search_limits().
+    std::vector<std::size_t> boundaries; // for expand_limits() and slide_limits().
+};
+
+template<typename Data_, typename Index_, typename Accumulate_>
+void define_windows(const std::size_t num_points, const Data_* const x, const Options<Data_, Accumulate_>& opt, PrecomputedWindows<Data_, Index_>& output, WindowBuffers<Data_, Index_>& buffers) {
+    auto& anchors = output.anchors;
     if (num_points == 0) {
-        return output;
+        anchors.clear();
+        output.ties.run_ids.clear();
+        output.ties.run_starts.clear();
+        output.freq_weights = NULL;
+        output.total_weight = 0;
+        output.limits.clear();
+        output.stencil.halfwidth = 0;
+        return;
     }
 
-    if (!std::is_sorted(x, x + num_points)) {
+    // Checking that all indices (including the end of the last tied run) fit into Index_.
+    sanisizer::cast<Index_>(num_points);
+
+    if (!parallel_is_sorted(num_points, x, opt.num_threads, buffers.chunk_flags)) {
         throw std::runtime_error("'x' should be sorted");
     }
 
@@ -287,31 +1235,118 @@ PrecomputedWindows<Data_> define_windows(const std::size_t num_points, const Dat
         delta.reset();
     }
 
+    build_tie_index(num_points, x, output.ties, opt.num_threads, buffers.chunk_counts);
+
     // Finding the anchors.
-    auto& anchors = output.anchors;
     if (delta.has_value()) {
         if (*delta == 0) {
             sanisizer::resize(anchors, num_points);
-            std::iota(anchors.begin(), anchors.end(), static_cast<std::size_t>(0));
+            std::iota(anchors.begin(), anchors.end(), static_cast<Index_>(0));
         } else {
-            internal::find_anchors(num_points, x, *delta, anchors);
+            find_anchors(num_points, x, *delta, anchors, opt.num_threads, buffers.speculative, buffers.chunk_counts);
         }
     } else {
         if (opt.anchors >= num_points) {
             sanisizer::resize(anchors, num_points);
-            std::iota(anchors.begin(), anchors.end(), static_cast<std::size_t>(0));
+            std::iota(anchors.begin(), anchors.end(), static_cast<Index_>(0));
         } else {
-            Data_ eff_delta = internal::derive_delta(opt.anchors, num_points, x);
-            internal::find_anchors(num_points, x, eff_delta, anchors);
+            Data_ eff_delta = derive_delta(opt.anchors, num_points, x, buffers.diffs, opt.num_threads, buffers.block_sums);
+            find_anchors(num_points, x, eff_delta, anchors, opt.num_threads, buffers.speculative, buffers.chunk_counts);
         }
     }
 
     // Computing the span weight that each window must achieve.
     output.freq_weights = (opt.frequency_weights ? opt.weights : NULL);
-    output.total_weight = (output.freq_weights != NULL ? std::accumulate(output.freq_weights, output.freq_weights + num_points, static_cast<Data_>(0)) : num_points);
+    output.total_weight = (output.freq_weights != NULL ? parallel_sum(num_points, output.freq_weights, opt.num_threads, buffers.block_sums) : num_points);
     const Data_ span_weight = (opt.span_as_proportion ? opt.span * output.total_weight : opt.span);
-    output.limits = internal::find_limits(anchors, span_weight, num_points, x, output.freq_weights, opt.minimum_width, opt.num_threads); 
+    fill_limits(anchors, span_weight, num_points, x, output.freq_weights, output.ties, opt.minimum_width, opt.num_threads, opt.search_windows, output.limits, buffers.prefix, buffers.boundaries);
 
+    // Building a stencil from the middle anchor, under the assumption that it
+    // has the same window as most other interior anchors on a regular grid.
+    auto& stencil = output.stencil;
+    stencil.halfwidth = 0;
+    if (opt.regular_grid) {
+        const auto step = find_grid_step(num_points, x, opt.num_threads, buffers.chunk_flags);
+        if (step.has_value()) {
+            const auto mid = anchors.size() / 2;
+            const std::size_t curpt = anchors[mid];
+            const auto& curlim = output.limits[mid];
+            const std::size_t halfwidth = std::max(curpt - curlim.left, curlim.right - curpt);
+            if (halfwidth > 1 && curlim.distance > 0) {
+                stencil.halfwidth = halfwidth;
+                stencil.num_points = num_points;
+                stencil.distance = curlim.distance;
+                stencil.tolerance = grid_tolerance(num_points, x);
+                const auto width = sanisizer::sum<std::size_t>(sanisizer::product<std::size_t>(halfwidth, 2), 1);
+                sanisizer::resize(stencil.weights, width);
+                sanisizer::resize(stencil.offsets, width);
+                stencil.total_weight = 0;
+                for (I<decltype(width)> j = 0; j < width; ++j) {
+                    const Data_ offset = static_cast<Data_>(j) - static_cast<Data_>(halfwidth);
+                    stencil.offsets[j] = offset;
+                    stencil.weights[j] = tricube(offset * *step, curlim.distance);
+                    stencil.total_weight += stencil.weights[j];
+                }
+            }
+        }
+    }
+}
+
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Overload of `define_windows()` that re-uses memory from previous calls.
+ * This is useful for avoiding heap allocations when defining windows for many small datasets.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ * 
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * @param opt Further options, see the other overload of `define_windows()` for details.
+ * @param[out] output Precomputed windows for use in `compute()`.
+ * On output, this is filled with the windows for `x`, re-using any existing memory where possible.
+ * @param work Workspace for temporary buffers.
+ */
+template<typename Data_, typename Index_, typename Accumulate_>
+void define_windows(const std::size_t num_points, const Data_* const x, const Options<Data_, Accumulate_>& opt, PrecomputedWindows<Data_, Index_>& output, Workspace<Data_, Index_>& work) {
+    internal::define_windows(num_points, x, opt, output, work.window_buffers);
+}
+
+/**
+ * Identify anchor points and precompute the associated windows prior to LOWESS smoothing via `compute()`. 
+ * This avoids wasting time in unnecessarily recomputing the same windows for the same `x` but different `y` in multiple `compute()` calls.
+ *
+ * @tparam Data_ Floating-point type of the data.
+ * @tparam Index_ Integer type of the point indices, see `PrecomputedWindows`.
+ * An error is raised if `num_points` cannot be represented by `Index_`.
+ * @tparam Accumulate_ Floating-point type for accumulating sums, see `Options`.
+ * 
+ * @param num_points Number of points.
+ * @param[in] x Pointer to an array of `num_points` x-coordinates, sorted in increasing order.
+ * (Consider using `SortBy` to permute the array in-place before calling this function.)
+ * @param opt Further options.
+ * Only a subset of options are actually used here, namely
+ * `Options::delta`,
+ * `Options::anchors`,
+ * `Options::weights`,
+ * `Options::frequency_weights`,
+ * `Options::span`,
+ * `Options::span_as_proportion`,
+ * `Options::minimum_width`
+ * and `Options::regular_grid`.
+ *
+ * @return The precomputed windows for use in `compute()`.
+ */
+template<typename Data_, typename Index_ = std::size_t, typename Accumulate_>
+PrecomputedWindows<Data_, Index_> define_windows(const std::size_t num_points, const Data_* const x, const Options<Data_, Accumulate_>& opt) {
+    PrecomputedWindows<Data_, Index_> output;
+    internal::WindowBuffers<Data_, Index_> buffers;
+    internal::define_windows(num_points, x, opt, output, buffers);
     return output;
 }
 
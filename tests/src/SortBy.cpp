@@ -1,7 +1,18 @@
 #include <gtest/gtest.h>
+
+// Checking that SortBy can still be forward-declared as a class.
+namespace WeightedLowess {
+class SortBy;
+}
+
 #include "WeightedLowess/SortBy.hpp"
 #include "utils.h"
 
+#include <random>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
 TEST(SortBy, Basic) {
     auto sim = simulate(800, /* sorted = */ false);
     const auto& x1 = sim.first;
@@ -46,3 +57,142 @@ TEST(SortBy, AlreadySorted) {
     sorter.unpermute(test.data(), work);
     EXPECT_EQ(test, sim.first);
 }
+
+template<typename Type_>
+void check_sorted_permutation(const std::vector<Type_>& x, int nthreads) {
+    WeightedLowess::SortBy sorter(x.size(), x.data(), nthreads);
+    std::vector<uint8_t> work;
+
+    auto test = x;
+    sorter.permute(test.data(), work);
+    auto ref = x;
+    std::sort(ref.begin(), ref.end());
+    EXPECT_EQ(test, ref);
+
+    sorter.unpermute(test.data(), work);
+    EXPECT_EQ(test, x);
+}
+
+TEST(SortBy, Radix) {
+    std::mt19937_64 rng(99);
+    std::normal_distribution<double> ndist;
+
+    std::vector<double> x(5000);
+    for (auto& v : x) {
+        v = ndist(rng) * 100;
+    }
+    x[0] = -0.0;
+    x[1] = 0.0;
+    x[2] = std::numeric_limits<double>::infinity();
+    x[3] = -std::numeric_limits<double>::infinity();
+    x[4] = x[5]; // some ties.
+    x[6] = x[5];
+
+    std::vector<float> xf(x.begin(), x.end());
+    std::vector<int> xi(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        xi[i] = (i % 2 ? -1 : 1) * static_cast<int>(rng() % 1000);
+    }
+    std::vector<uint64_t> xu(x.size());
+    for (auto& v : xu) {
+        v = rng();
+    }
+
+    for (int nthreads : { 1, 3 }) {
+        check_sorted_permutation(x, nthreads);
+        check_sorted_permutation(xf, nthreads);
+        check_sorted_permutation(xi, nthreads);
+        check_sorted_permutation(xu, nthreads);
+    }
+
+    // Also works for data with a narrow range, where some passes are skipped.
+    std::vector<double> narrow(x.size());
+    for (auto& v : narrow) {
+        v = 1 + (rng() % 100) / 128.0;
+    }
+    check_sorted_permutation(narrow, 1);
+    check_sorted_permutation(narrow, 4);
+}
+
+TEST(SortBy, NearlySorted) {
+    auto sim = simulate(3000, /* sorted = */ true);
+    auto x = sim.first;
+
+    // Shifting a few batches out of order.
+    std::rotate(x.begin() + 100, x.begin() + 500, x.begin() + 900);
+    std::rotate(x.begin() + 1500, x.begin() + 2800, x.end());
+    x[2000] = -1;
+    for (int nthreads : { 1, 2, 5 }) {
+        check_sorted_permutation(x, nthreads);
+    }
+
+    // Ties across runs should be handled correctly.
+    std::vector<double> tied { 3, 3, 1, 1, 2, 2, 0, 0 };
+    check_sorted_permutation(tied, 1);
+    check_sorted_permutation(tied, 3);
+
+    // Just above the limit for merging.
+    std::vector<double> sawtooth;
+    for (int r = 0; r < 65; ++r) {
+        for (int i = 0; i < 20; ++i) {
+            sawtooth.push_back(i + r / 100.0);
+        }
+    }
+    check_sorted_permutation(sawtooth, 1);
+    check_sorted_permutation(sawtooth, 2);
+}
+
+TEST(SortBy, OutOfPlace) {
+    for (bool sorted : { false, true }) {
+        auto sim = simulate(2000, sorted);
+        const auto& x = sim.first;
+        const auto& y = sim.second;
+
+        WeightedLowess::SortBy sorter(x.size(), x.data());
+        std::vector<uint8_t> work;
+        auto refx = x, refy = y;
+        sorter.permute({ refx.data(), refy.data() }, work);
+
+        for (int nthreads : { 1, 3 }) {
+            std::vector<double> outx(x.size()), outy(y.size());
+            sorter.permute_into(x.data(), outx.data(), nthreads);
+            sorter.permute_into(y.data(), outy.data(), nthreads);
+            EXPECT_EQ(outx, refx);
+            EXPECT_EQ(outy, refy);
+
+            std::vector<double> backx(x.size()), backy(y.size());
+            sorter.unpermute_into(outx.data(), backx.data(), nthreads);
+            sorter.unpermute_into(outy.data(), backy.data(), nthreads);
+            EXPECT_EQ(backx, x);
+            EXPECT_EQ(backy, y);
+        }
+    }
+}
+
+TEST(SortBy, SmallIndex) {
+    auto sim = simulate(3000, /* sorted = */ false);
+    const auto& x = sim.first;
+    WeightedLowess::SortBy ref(x.size(), x.data());
+    WeightedLowess::BasicSortBy<std::uint32_t> sorter(x.size(), x.data(), 2);
+
+    std::vector<uint8_t> work;
+    auto expected = x;
+    ref.permute(expected.data(), work);
+    auto observed = x;
+    sorter.permute(observed.data(), work);
+    EXPECT_EQ(expected, observed);
+
+    std::vector<double> gathered(x.size());
+    sorter.permute_into(x.data(), gathered.data());
+    EXPECT_EQ(expected, gathered);
+    sorter.unpermute(observed.data(), work);
+    EXPECT_EQ(observed, x);
+
+    // Also works for the merging of nearly-sorted inputs.
+    auto nearly = simulate(3000, /* sorted = */ true).first;
+    std::rotate(nearly.begin(), nearly.begin() + 1000, nearly.end());
+    WeightedLowess::BasicSortBy<std::uint16_t> small_sorter(nearly.size(), nearly.data());
+    auto snearly = nearly;
+    small_sorter.permute(snearly.data(), work);
+    EXPECT_TRUE(std::is_sorted(snearly.begin(), snearly.end()));
+}
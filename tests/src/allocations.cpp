@@ -0,0 +1,204 @@
+// GCC complains about free() on pointers from the replaced operator new below,
+// which is exactly what we intend.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+// Replacing the global allocation functions to count the number of heap
+// allocations. This is done in a separate executable so that it doesn't
+// affect the other tests. We also count the allocations that occur inside
+// parallel sections, as these must not throw.
+static std::atomic<std::size_t> num_allocations(0);
+static std::atomic<std::size_t> num_parallel_allocations(0);
+
+// Running all tasks in the calling thread, so that we can check for
+// allocations with multiple threads without counting those of the threads
+// themselves. The chunking for multiple threads is still exercised as it only
+// depends on the requested number of threads.
+template<typename Task_, class Run_>
+int serial_parallelize(const int num_workers, const Task_ num_tasks, Run_ run) {
+    if (num_tasks <= 0) {
+        return 0;
+    }
+
+    const Task_ per_worker = num_tasks / num_workers + (num_tasks % num_workers > 0);
+    int used = 0;
+    for (Task_ start = 0; start < num_tasks; start += per_worker, ++used) {
+        const std::size_t before = num_allocations;
+        run(used, start, std::min<Task_>(per_worker, num_tasks - start));
+        num_parallel_allocations += num_allocations - before;
+    }
+    return used;
+}
+
+#define WEIGHTEDLOWESS_CUSTOM_PARALLEL serial_parallelize
+#include "WeightedLowess/compute.hpp"
+#include "WeightedLowess/compute_unsorted.hpp"
+#include "WeightedLowess/batch.hpp"
+#include "utils.h"
+
+void* operator new(std::size_t size) {
+    ++num_allocations;
+    if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+class AllocationTest : public ::testing::TestWithParam<int> {
+protected:
+    template<class Run_>
+    static std::size_t count_allocations(Run_ run) {
+        const std::size_t before = num_allocations;
+        run();
+        return num_allocations - before;
+    }
+};
+
+TEST_P(AllocationTest, Compute) {
+    const int nthreads = GetParam();
+
+    // Using enough points for the sums in derive_delta() to be split into blocks.
+    auto simulated = simulate(70000);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+    const auto n = x.size();
+
+    std::vector<double> weights(n);
+    for (size_t i = 0; i < n; ++i) {
+        weights[i] = (i % 7) + 0.5;
+    }
+
+    std::vector<double> grid(n);
+    for (size_t i = 0; i < n; ++i) {
+        grid[i] = i;
+    }
+
+    auto configure = [&](const int choice) -> WeightedLowess::Options<double> {
+        WeightedLowess::Options<double> opt;
+        opt.span = 0.02;
+        opt.num_threads = nthreads;
+        switch (choice) {
+            case 1:
+                opt.weights = weights.data();
+                break;
+            case 2:
+                opt.weights = weights.data();
+                opt.frequency_weights = true;
+                break;
+            case 3:
+                opt.weights = weights.data();
+                opt.frequency_weights = true;
+                opt.search_windows = true;
+                break;
+            case 4:
+                opt.delta = 0.01;
+                break;
+        }
+        return opt;
+    };
+
+    std::vector<double> fitted(n), robust_weights(n);
+    for (int choice = 0; choice <= 4; ++choice) {
+        const auto opt = configure(choice);
+        WeightedLowess::Workspace<double> work;
+        WeightedLowess::compute(n, x.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+
+        const auto ref = WeightedLowess::compute(n, x.data(), y.data(), opt);
+        EXPECT_EQ(ref.fitted, fitted);
+
+        auto nallocs = count_allocations([&]() -> void {
+            WeightedLowess::compute(n, x.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+        });
+        EXPECT_EQ(nallocs, 0) << "choice " << choice;
+        EXPECT_EQ(ref.fitted, fitted);
+
+        nallocs = count_allocations([&]() -> void {
+            WeightedLowess::define_windows(n, x.data(), opt, work.windows, work);
+        });
+        EXPECT_EQ(nallocs, 0) << "choice " << choice;
+
+        nallocs = count_allocations([&]() -> void {
+            WeightedLowess::compute_unsorted(n, x.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+        });
+        EXPECT_EQ(nallocs, 0) << "choice " << choice;
+    }
+
+    // Checking that sorting also re-uses its buffers, for both the radix sort and the merge of sorted runs.
+    auto unsorted = simulate(n, /* sorted = */ false);
+    auto nearly = x;
+    std::rotate(nearly.begin() + n / 3, nearly.begin() + n / 2, nearly.end());
+    for (const auto& current : { unsorted.first, nearly }) {
+        const auto opt = configure(0);
+        WeightedLowess::Workspace<double> work;
+        WeightedLowess::compute_unsorted(n, current.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+        auto nallocs = count_allocations([&]() -> void {
+            WeightedLowess::compute_unsorted(n, current.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+        });
+        EXPECT_EQ(nallocs, 0);
+    }
+
+    // Also checking the stencil for regular grids.
+    auto opt = configure(0);
+    opt.regular_grid = true;
+    WeightedLowess::Workspace<double> work;
+    WeightedLowess::compute(n, grid.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+    auto nallocs = count_allocations([&]() -> void {
+        WeightedLowess::compute(n, grid.data(), y.data(), fitted.data(), robust_weights.data(), opt, work);
+    });
+    EXPECT_EQ(nallocs, 0);
+}
+
+TEST_P(AllocationTest, Batch) {
+    const int nthreads = GetParam();
+    auto simulated = simulate(5000);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+    const auto n = x.size();
+
+    const std::size_t nc = 20;
+    std::vector<double> ymat;
+    for (std::size_t c = 0; c < nc; ++c) {
+        ymat.insert(ymat.end(), y.begin(), y.end());
+    }
+    std::vector<double> fitted(ymat.size()), robust_weights(ymat.size());
+
+    for (int choice = 0; choice < 2; ++choice) {
+        WeightedLowess::Options<double> opt;
+        opt.num_threads = nthreads;
+        if (choice) {
+            opt.incremental_threshold = 0.01;
+            opt.convergence_tolerance = 1e-8;
+        }
+        const auto windows = WeightedLowess::define_windows(n, x.data(), opt);
+
+        for (int row_major = 0; row_major < 2; ++row_major) {
+            num_parallel_allocations = 0;
+            WeightedLowess::compute_batch(n, x.data(), windows, nc, ymat.data(), row_major, fitted.data(), robust_weights.data(), opt);
+            EXPECT_EQ(num_parallel_allocations, 0) << "choice " << choice << ", row major " << row_major;
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Allocation,
+    AllocationTest,
+    ::testing::Values(1, 4) // number of threads
+);
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include "WeightedLowess/batch.hpp"
+#include "WeightedLowess/compute.hpp"
+#include "utils.h"
+
+class BatchTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    static std::vector<double> simulate_matrix(size_t nr, size_t nc) {
+        std::mt19937_64 rng(nr * nc);
+        std::normal_distribution ndist;
+        std::vector<double> output(nr * nc);
+        for (auto& o : output) {
+            o = ndist(rng);
+        }
+        return output;
+    }
+};
+
+TEST_P(BatchTest, ColumnMajor) {
+    auto simulated = simulate(500);
+    const auto& x = simulated.first;
+    const auto param = GetParam();
+    const size_t nc = std::get<0>(param);
+
+    WeightedLowess::Options opt;
+    opt.num_threads = std::get<1>(param);
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto y = simulate_matrix(x.size(), nc);
+
+    std::vector<double> fitted(y.size()), rweights(y.size());
+    WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), false, fitted.data(), rweights.data(), opt);
+
+    for (size_t c = 0; c < nc; ++c) {
+        std::vector<double> ycol(y.begin() + c * x.size(), y.begin() + (c + 1) * x.size());
+        auto ref = WeightedLowess::compute(x.size(), x.data(), ycol.data(), opt);
+        EXPECT_EQ(ref.fitted, std::vector<double>(fitted.begin() + c * x.size(), fitted.begin() + (c + 1) * x.size()));
+        EXPECT_EQ(ref.robust_weights, std::vector<double>(rweights.begin() + c * x.size(), rweights.begin() + (c + 1) * x.size()));
+    }
+
+    // Works without robustness weights.
+    std::vector<double> fitted2(y.size());
+    WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), false, fitted2.data(), static_cast<double*>(NULL), opt);
+    EXPECT_EQ(fitted, fitted2);
+}
+
+TEST_P(BatchTest, RowMajor) {
+    auto simulated = simulate(400);
+    const auto& x = simulated.first;
+    const auto param = GetParam();
+    const size_t nc = std::get<0>(param);
+
+    WeightedLowess::Options opt;
+    opt.num_threads = std::get<1>(param);
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto y = simulate_matrix(x.size(), nc);
+
+    std::vector<double> fitted(y.size()), rweights(y.size());
+    WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), true, fitted.data(), rweights.data(), opt);
+
+    for (size_t c = 0; c < nc; ++c) {
+        std::vector<double> ycol(x.size());
+        for (size_t i = 0; i < x.size(); ++i) {
+            ycol[i] = y[i * nc + c];
+        }
+        auto ref = WeightedLowess::compute(x.size(), x.data(), ycol.data(), opt);
+        for (size_t i = 0; i < x.size(); ++i) {
+            EXPECT_EQ(ref.fitted[i], fitted[i * nc + c]);
+            EXPECT_EQ(ref.robust_weights[i], rweights[i * nc + c]);
+        }
+    }
+
+    std::vector<double> fitted2(y.size());
+    WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), true, fitted2.data(), static_cast<double*>(NULL), opt);
+    EXPECT_EQ(fitted, fitted2);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Batch,
+    BatchTest,
+    ::testing::Combine(
+        ::testing::Values(1, 2, 7, 19), // number of columns
+        ::testing::Values(1, 3) // number of threads
+    )
+);
+
+TEST(Batch, Empty) {
+    WeightedLowess::Options opt;
+    std::vector<double> x, y, fitted;
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    WeightedLowess::compute_batch(x.size(), x.data(), windows, 5, y.data(), false, fitted.data(), static_cast<double*>(NULL), opt);
+    EXPECT_TRUE(fitted.empty());
+}
+
+TEST(Batch, Weighted) {
+    auto simulated = simulate(300);
+    const auto& x = simulated.first;
+    std::vector<double> weights(x.size());
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution udist;
+    for (auto& w : weights) {
+        w = udist(rng);
+    }
+
+    WeightedLowess::Options opt;
+    opt.weights = weights.data();
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+
+    const size_t nc = 11;
+    std::vector<double> y(x.size() * nc);
+    std::normal_distribution ndist;
+    for (auto& yy : y) {
+        yy = ndist(rng);
+    }
+
+    std::vector<double> fitted(y.size());
+    WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), false, fitted.data(), static_cast<double*>(NULL), opt);
+    for (size_t c = 0; c < nc; ++c) {
+        auto ref = WeightedLowess::compute(x.size(), x.data(), y.data() + c * x.size(), opt);
+        EXPECT_EQ(ref.fitted, std::vector<double>(fitted.begin() + c * x.size(), fitted.begin() + (c + 1) * x.size()));
+    }
+}
+
+TEST(Batch, Iterations) {
+    auto simulated = simulate(300);
+    const auto& x = simulated.first;
+    const size_t nc = 13;
+    std::vector<double> y(x.size() * nc);
+    std::mt19937_64 rng(100);
+    std::normal_distribution ndist;
+    for (auto& yy : y) {
+        yy = ndist(rng);
+    }
+
+    std::vector<double> fitted(y.size());
+    for (int nthreads = 1; nthreads <= 3; nthreads += 2) {
+        WeightedLowess::Options opt;
+        opt.num_threads = nthreads;
+        const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+        EXPECT_EQ(WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), false, fitted.data(), static_cast<double*>(NULL), opt), opt.iterations);
+
+        // Same as the maximum across the individual calls to compute() with early termination.
+        opt.iterations = 20;
+        opt.convergence_tolerance = 1e-4;
+        int expected = 0;
+        for (size_t c = 0; c < nc; ++c) {
+            auto ref = WeightedLowess::compute(x.size(), x.data(), y.data() + c * x.size(), opt);
+            expected = std::max(expected, ref.iterations);
+        }
+        EXPECT_LT(expected, opt.iterations);
+        EXPECT_EQ(WeightedLowess::compute_batch(x.size(), x.data(), windows, nc, y.data(), false, fitted.data(), static_cast<double*>(NULL), opt), expected);
+    }
+}
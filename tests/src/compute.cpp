@@ -1,7 +1,17 @@
 #include <gtest/gtest.h>
 #include "WeightedLowess/compute.hpp"
+#include "WeightedLowess/compute_unsorted.hpp"
+#include "WeightedLowess/batch.hpp"
+#include "WeightedLowess/operator.hpp"
+#include "WeightedLowess/interpolate.hpp"
 #include "utils.h"
 
+#include <cstdint>
+#include <tuple>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
 class ComputeTest : public ::testing::TestWithParam<int> {};
 
 TEST_P(ComputeTest, Exact) {
@@ -210,6 +220,509 @@ TEST(ComputeTests, QuitEarly) {
     }
 }
 
+TEST(ComputeTests, NoIterations) {
+    auto simulated = simulate(1004);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+
+    WeightedLowess::Options opt;
+    opt.iterations = 0;
+    auto win = WeightedLowess::define_windows(x.size(), x.data(), opt);
+
+    // Robustness weights should be set to 1 even if the output buffer contains garbage.
+    std::vector<double> fitted(x.size()), robust_weights(x.size(), -1);
+    WeightedLowess::compute(x.size(), x.data(), win, y.data(), fitted.data(), robust_weights.data(), opt);
+    EXPECT_EQ(robust_weights, std::vector<double>(x.size(), 1));
+
+    // Same for a constant 'y', which quits early.
+    std::vector<double> consty(x.size(), 5);
+    opt.iterations = 3;
+    std::fill(robust_weights.begin(), robust_weights.end(), -1);
+    WeightedLowess::compute(x.size(), x.data(), win, consty.data(), fitted.data(), robust_weights.data(), opt);
+    EXPECT_EQ(robust_weights, std::vector<double>(x.size(), 1));
+    EXPECT_EQ(fitted, consty);
+}
+
+TEST(ComputeTests, Workspace) {
+    WeightedLowess::Workspace<double> work;
+    WeightedLowess::Results<double> res(0);
+
+    for (size_t n : { 1000, 50, 0, 1000, 200 }) {
+        auto simulated = simulate(n);
+        const auto& x = simulated.first;
+        const auto& y = simulated.second;
+
+        WeightedLowess::Options opt;
+        opt.anchors = 50;
+        auto ref = WeightedLowess::compute(n, x.data(), y.data(), opt);
+        WeightedLowess::compute(n, x.data(), y.data(), opt, res, work);
+        EXPECT_EQ(ref.fitted, res.fitted);
+        EXPECT_EQ(ref.robust_weights, res.robust_weights);
+
+        std::vector<double> fitted(n);
+        WeightedLowess::compute(n, x.data(), y.data(), fitted.data(), static_cast<double*>(NULL), opt, work);
+        EXPECT_EQ(ref.fitted, fitted);
+    }
+
+    // Checking that no reallocation occurs once the workspace is large enough.
+    auto simulated = simulate(500);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+    WeightedLowess::Options opt;
+    WeightedLowess::compute(x.size(), x.data(), y.data(), opt, res, work);
+    const auto abs_ptr = work.abs_dev.data();
+    const auto limit_ptr = work.windows.limits.data();
+    const auto fit_ptr = res.fitted.data();
+    WeightedLowess::compute(x.size(), x.data(), y.data(), opt, res, work);
+    EXPECT_EQ(abs_ptr, work.abs_dev.data());
+    EXPECT_EQ(limit_ptr, work.windows.limits.data());
+    EXPECT_EQ(fit_ptr, res.fitted.data());
+}
+
+TEST(ComputeTests, SmallIndex) {
+    auto simulated = simulate(1001);
+    auto x = simulated.first;
+    const auto& y = simulated.second;
+    x[10] = x[11]; // throwing in some ties.
+    x[12] = x[11];
+
+    std::vector<double> weights(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        weights[i] = (i % 5) + 1;
+    }
+
+    for (bool use_weights : { false, true }) {
+        WeightedLowess::Options opt;
+        opt.anchors = 97;
+        if (use_weights) {
+            opt.weights = weights.data();
+        }
+
+        const auto ref_win = WeightedLowess::define_windows(x.size(), x.data(), opt);
+        const auto win = WeightedLowess::define_windows<double, std::uint32_t>(x.size(), x.data(), opt);
+        EXPECT_EQ(std::vector<size_t>(win.anchors.begin(), win.anchors.end()), ref_win.anchors);
+        ASSERT_EQ(win.limits.size(), ref_win.limits.size());
+        for (size_t s = 0; s < win.limits.size(); ++s) {
+            EXPECT_EQ(win.limits[s].left, ref_win.limits[s].left);
+            EXPECT_EQ(win.limits[s].right, ref_win.limits[s].right);
+            EXPECT_EQ(win.limits[s].distance, ref_win.limits[s].distance);
+        }
+
+        std::vector<double> ref_fitted(x.size()), ref_rweights(x.size());
+        WeightedLowess::compute(x.size(), x.data(), ref_win, y.data(), ref_fitted.data(), ref_rweights.data(), opt);
+        std::vector<double> fitted(x.size()), rweights(x.size());
+        WeightedLowess::compute(x.size(), x.data(), win, y.data(), fitted.data(), rweights.data(), opt);
+        EXPECT_EQ(ref_fitted, fitted);
+        EXPECT_EQ(ref_rweights, rweights);
+
+        WeightedLowess::Workspace<double, std::uint32_t> work;
+        WeightedLowess::compute(x.size(), x.data(), y.data(), fitted.data(), rweights.data(), opt, work);
+        EXPECT_EQ(ref_fitted, fitted);
+        EXPECT_EQ(ref_rweights, rweights);
+
+        std::vector<double> batched(x.size());
+        WeightedLowess::compute_batch(x.size(), x.data(), win, 1, y.data(), false, batched.data(), static_cast<double*>(NULL), opt);
+        EXPECT_EQ(ref_fitted, batched);
+
+        std::vector<double> interpolated(x.size());
+        WeightedLowess::interpolate(x.data(), win, fitted.data(), x.size(), x.data(), interpolated.data(), 1);
+        compare_almost_equal(interpolated, fitted);
+
+        auto oopt = opt;
+        oopt.iterations = 0;
+        const auto op = WeightedLowess::define_operator(x.size(), x.data(), win, oopt);
+        std::vector<double> opfitted(x.size());
+        WeightedLowess::apply_operator(op, y.data(), opfitted.data(), 1);
+        auto ref_oper = WeightedLowess::compute(x.size(), x.data(), y.data(), oopt);
+        compare_almost_equal(ref_oper.fitted, opfitted);
+    }
+
+    auto unsorted = simulate(1002, /* sorted = */ false);
+    WeightedLowess::Options opt;
+    auto ref = WeightedLowess::compute_unsorted(unsorted.first.size(), unsorted.first.data(), unsorted.second.data(), opt);
+    WeightedLowess::Workspace<double, std::uint32_t> work;
+    std::vector<double> fitted(unsorted.first.size());
+    WeightedLowess::compute_unsorted(unsorted.first.size(), unsorted.first.data(), unsorted.second.data(), fitted.data(), static_cast<double*>(NULL), opt, work);
+    EXPECT_EQ(ref.fitted, fitted);
+}
+
+TEST(ComputeTests, MixedPrecision) {
+    auto simulated = simulate(20000);
+    std::vector<float> xf(simulated.first.begin(), simulated.first.end());
+    std::vector<float> yf(simulated.second.begin(), simulated.second.end());
+    for (auto& y : yf) {
+        y += 100; // large offset to amplify the loss of precision in the sums.
+    }
+    std::vector<double> xd(xf.begin(), xf.end()), yd(yf.begin(), yf.end());
+
+    WeightedLowess::Options<double> dopt;
+    dopt.anchors = 50;
+    auto ref = WeightedLowess::compute(xd.size(), xd.data(), yd.data(), dopt);
+
+    // Using double for the accumulators has no effect when Data_ is already double.
+    WeightedLowess::Options<double, double> ddopt;
+    ddopt.anchors = 50;
+    auto dres = WeightedLowess::compute(xd.size(), xd.data(), yd.data(), ddopt);
+    EXPECT_EQ(ref.fitted, dres.fitted);
+    EXPECT_EQ(ref.robust_weights, dres.robust_weights);
+
+    WeightedLowess::Options<float> fopt;
+    fopt.anchors = 50;
+    auto fres = WeightedLowess::compute(xf.size(), xf.data(), yf.data(), fopt);
+
+    WeightedLowess::Options<float, double> mopt;
+    mopt.anchors = 50;
+    auto mres = WeightedLowess::compute(xf.size(), xf.data(), yf.data(), mopt);
+
+    double ferr = 0, merr = 0;
+    for (std::size_t i = 0; i < xd.size(); ++i) {
+        ferr = std::max(ferr, std::abs(static_cast<double>(fres.fitted[i]) - ref.fitted[i]));
+        merr = std::max(merr, std::abs(static_cast<double>(mres.fitted[i]) - ref.fitted[i]));
+    }
+    EXPECT_LT(merr, ferr);
+    EXPECT_LT(merr, 1e-3);
+
+    // Same for the interpolation.
+    auto win = WeightedLowess::define_windows(xf.size(), xf.data(), mopt);
+    std::vector<float> interpolated(xf.size());
+    WeightedLowess::interpolate<float, std::size_t, double>(xf.data(), win, mres.fitted.data(), xf.size(), xf.data(), interpolated.data(), 1);
+    for (std::size_t i = 0; i < xf.size(); ++i) {
+        EXPECT_NEAR(interpolated[i], mres.fitted[i], 1e-4);
+    }
+}
+
+class ComputeFastSumsTest : public ::testing::TestWithParam<std::tuple<bool, bool, int> > {};
+
+TEST_P(ComputeFastSumsTest, Basic) {
+    auto param = GetParam();
+    const bool exact = std::get<0>(param);
+    const bool weighted = std::get<1>(param);
+    const int nthreads = std::get<2>(param);
+
+    auto simulated = simulate(2001);
+    auto& x = simulated.first;
+    const auto& y = simulated.second;
+    for (std::size_t i = 1; i < x.size(); i += 10) { // injecting some ties.
+        x[i] = x[i - 1];
+    }
+
+    std::vector<double> weights(x.size());
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        weights[i] = 1 + (i % 7) / 3.0;
+    }
+
+    WeightedLowess::Options opt;
+    opt.num_threads = nthreads;
+    if (exact) {
+        opt.delta = 0;
+    }
+    if (weighted) {
+        opt.weights = weights.data();
+    }
+    auto ref = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+
+    opt.fast_sums = true;
+    auto res = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        EXPECT_NEAR(ref.fitted[i], res.fitted[i], 1e-8);
+        EXPECT_NEAR(ref.robust_weights[i], res.robust_weights[i], 1e-6);
+    }
+
+    // Checking that it behaves with a large offset and a small span.
+    std::vector<double> xshift(x);
+    for (auto& xs : xshift) {
+        xs = xs / 100 + 1000;
+    }
+    opt.span = 0.05;
+    opt.fast_sums = false;
+    auto ref2 = WeightedLowess::compute(x.size(), xshift.data(), y.data(), opt);
+    opt.fast_sums = true;
+    auto res2 = WeightedLowess::compute(x.size(), xshift.data(), y.data(), opt);
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        EXPECT_NEAR(ref2.fitted[i], res2.fitted[i], 1e-6);
+    }
+
+    // Checking that the power sums are still accurate when the offset is much
+    // larger than the spread. Every point is an anchor, so that we don't pick
+    // up the round-off error from interpolating with large x-coordinates.
+    for (double offset : { 1e5, 1e6 }) {
+        for (auto& xs : xshift) {
+            xs = offset;
+        }
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            xshift[i] += x[i] / 100;
+        }
+        opt.delta = 0;
+        opt.fast_sums = false;
+        auto ref3 = WeightedLowess::compute(x.size(), xshift.data(), y.data(), opt);
+        opt.fast_sums = true;
+        auto res3 = WeightedLowess::compute(x.size(), xshift.data(), y.data(), opt);
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            EXPECT_NEAR(ref3.fitted[i], res3.fitted[i], 1e-9);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Compute,
+    ComputeFastSumsTest,
+    ::testing::Combine(
+        ::testing::Values(false, true), // exact
+        ::testing::Values(false, true), // weighted
+        ::testing::Values(1, 3) // number of threads
+    )
+);
+
+class ComputeRegularGridTest : public ::testing::TestWithParam<std::tuple<bool, bool, int> > {};
+
+TEST_P(ComputeRegularGridTest, Basic) {
+    auto param = GetParam();
+    const bool exact = std::get<0>(param);
+    const bool weighted = std::get<1>(param);
+    const int nthreads = std::get<2>(param);
+
+    const std::size_t n = 2001;
+    std::vector<double> x(n), weights(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        x[i] = 50 + i * 0.01;
+        weights[i] = 1 + (i % 7) / 3.0;
+    }
+    auto y = simulate(n).second;
+
+    WeightedLowess::Options opt;
+    opt.num_threads = nthreads;
+    if (exact) {
+        opt.delta = 0;
+    }
+    if (weighted) {
+        opt.weights = weights.data();
+        opt.frequency_weights = false; // otherwise the windows are not symmetric.
+    }
+    auto ref = WeightedLowess::compute(n, x.data(), y.data(), opt);
+
+    opt.regular_grid = true;
+    auto windows = WeightedLowess::define_windows(n, x.data(), opt);
+    EXPECT_GT(windows.stencil.halfwidth, 0);
+    std::vector<double> fitted(n), rweights(n);
+    WeightedLowess::compute(n, x.data(), windows, y.data(), fitted.data(), rweights.data(), opt);
+    for (std::size_t i = 0; i < n; ++i) {
+        EXPECT_NEAR(ref.fitted[i], fitted[i], 1e-8);
+        EXPECT_NEAR(ref.robust_weights[i], rweights[i], 1e-6);
+    }
+
+    // Same results with a smaller index type.
+    auto small_windows = WeightedLowess::define_windows<double, std::uint32_t>(n, x.data(), opt);
+    EXPECT_EQ(small_windows.stencil.halfwidth, windows.stencil.halfwidth);
+    std::vector<double> small_fitted(n), small_rweights(n);
+    WeightedLowess::compute(n, x.data(), small_windows, y.data(), small_fitted.data(), small_rweights.data(), opt);
+    EXPECT_EQ(fitted, small_fitted);
+    EXPECT_EQ(rweights, small_rweights);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Compute,
+    ComputeRegularGridTest,
+    ::testing::Combine(
+        ::testing::Values(false, true), // exact
+        ::testing::Values(false, true), // weighted
+        ::testing::Values(1, 3) // number of threads
+    )
+);
+
+TEST(ComputeTests, RegularGridIrregular) {
+    auto simulated = simulate(1001);
+    WeightedLowess::Options opt;
+    opt.regular_grid = true;
+    auto windows = WeightedLowess::define_windows(simulated.first.size(), simulated.first.data(), opt);
+    EXPECT_EQ(windows.stencil.halfwidth, 0);
+}
+
+TEST(ComputeTests, Incremental) {
+    auto simulated = simulate(1001);
+    const auto& x = simulated.first;
+    auto y = x;
+    for (std::size_t i = 0; i < y.size(); ++i) {
+        y[i] += simulated.second[i] * 0.1;
+    }
+    for (std::size_t i = 50; i < y.size(); i += 200) { // spiking in a few outliers.
+        y[i] += 10;
+    }
+
+    for (int nthreads : { 1, 3 }) {
+        WeightedLowess::Options opt;
+        opt.iterations = 5;
+        opt.num_threads = nthreads;
+        auto ref = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+
+        // With a zero threshold, the skipped anchors would have been refitted with the same weights anyway.
+        opt.incremental_threshold = 0;
+        auto res0 = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+        EXPECT_EQ(ref.fitted, res0.fitted);
+        EXPECT_EQ(ref.robust_weights, res0.robust_weights);
+
+        opt.incremental_threshold = 1e-3;
+        auto res = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            EXPECT_NEAR(ref.fitted[i], res.fitted[i], 1e-3);
+        }
+        for (std::size_t i = 50; i < y.size(); i += 200) {
+            EXPECT_EQ(res.robust_weights[i], 0);
+        }
+
+        // Works with the fast sums, which need to skip over unaffected anchors.
+        opt.fast_sums = true;
+        auto fres = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            EXPECT_NEAR(res.fitted[i], fres.fitted[i], 1e-6);
+        }
+    }
+}
+
+TEST(ComputeTests, Convergence) {
+    auto simulated = simulate(1001);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+
+    WeightedLowess::Options opt;
+    auto ref = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    EXPECT_EQ(ref.iterations, opt.iterations);
+
+    // Stops immediately if the tolerance is large.
+    opt.convergence_tolerance = 1;
+    auto res = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    EXPECT_EQ(res.iterations, 0);
+    opt.iterations = 0;
+    opt.convergence_tolerance.reset();
+    auto ref0 = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    EXPECT_EQ(res.fitted, ref0.fitted);
+
+    // Otherwise, it should give the same fit as the same number of iterations without early termination.
+    opt.iterations = 50;
+    opt.convergence_tolerance = 1e-4;
+    res = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    EXPECT_GT(res.iterations, 0);
+    EXPECT_LT(res.iterations, 50);
+    const auto conv_iterations = res.iterations;
+
+    opt.iterations = conv_iterations;
+    opt.convergence_tolerance.reset();
+    ref = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    EXPECT_EQ(ref.iterations, conv_iterations);
+    EXPECT_EQ(res.fitted, ref.fitted);
+    double maxdiff = 0;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        maxdiff = std::max(maxdiff, std::abs(res.robust_weights[i] - ref.robust_weights[i]));
+    }
+    EXPECT_LE(maxdiff, 1e-4);
+
+    // Works for the other overloads.
+    opt.iterations = 50;
+    opt.convergence_tolerance = 1e-4;
+    std::vector<double> fitted(x.size());
+    EXPECT_EQ(WeightedLowess::compute(x.size(), x.data(), y.data(), fitted.data(), static_cast<double*>(NULL), opt), conv_iterations);
+    EXPECT_EQ(fitted, res.fitted);
+
+    std::vector<double> rev_x(x.rbegin(), x.rend()), rev_y(y.rbegin(), y.rend());
+    auto unsorted = WeightedLowess::compute_unsorted(x.size(), rev_x.data(), rev_y.data(), opt);
+    EXPECT_EQ(unsorted.iterations, conv_iterations);
+
+    // Reports zero iterations if the fit quits early.
+    std::vector<double> flat(x.size(), 1);
+    auto fres = WeightedLowess::compute(x.size(), x.data(), flat.data(), opt);
+    EXPECT_EQ(fres.iterations, 0);
+}
+
+TEST(ComputeTests, WarmStart) {
+    auto simulated = simulate(1001);
+    const auto& x = simulated.first;
+    auto y = simulated.second;
+    for (std::size_t i = 50; i < y.size(); i += 200) { // spiking in a few outliers.
+        y[i] += 10;
+    }
+
+    WeightedLowess::Options opt;
+    opt.iterations = 1;
+    auto ref1 = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    opt.iterations = 2;
+    auto ref2 = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+    opt.iterations = 3;
+    auto ref3 = WeightedLowess::compute(x.size(), x.data(), y.data(), opt);
+
+    // Resuming from the robustness weights repeats the last fit and then performs more iterations.
+    {
+        WeightedLowess::Workspace<double> work;
+        auto res = ref1;
+        opt.warm_start = WeightedLowess::WarmStart::ROBUST_WEIGHTS;
+        opt.iterations = 2;
+        WeightedLowess::compute(x.size(), x.data(), y.data(), opt, res, work);
+        EXPECT_EQ(res.fitted, ref3.fitted);
+        EXPECT_EQ(res.robust_weights, ref3.robust_weights);
+        EXPECT_EQ(res.iterations, 2);
+
+        // Zero iterations just refits with the existing weights.
+        res = ref2;
+        opt.iterations = 0;
+        WeightedLowess::compute(x.size(), x.data(), y.data(), opt, res, work);
+        EXPECT_EQ(res.fitted, ref2.fitted);
+        EXPECT_EQ(res.robust_weights, ref2.robust_weights);
+    }
+
+    // Starting from the fitted values computes the robustness weights first.
+    {
+        std::vector<double> fitted = ref1.fitted, rweights(x.size());
+        opt.warm_start = WeightedLowess::WarmStart::FITTED;
+        opt.iterations = 1;
+        EXPECT_EQ(WeightedLowess::compute(x.size(), x.data(), y.data(), fitted.data(), rweights.data(), opt), 1);
+        EXPECT_EQ(fitted, ref3.fitted);
+        EXPECT_EQ(rweights, ref3.robust_weights);
+    }
+
+    // Works for unsorted inputs.
+    {
+        std::vector<double> rev_x(x.rbegin(), x.rend()), rev_y(y.rbegin(), y.rend());
+        std::vector<double> fitted(ref1.fitted.rbegin(), ref1.fitted.rend()), rweights(ref1.robust_weights.rbegin(), ref1.robust_weights.rend());
+        opt.warm_start = WeightedLowess::WarmStart::ROBUST_WEIGHTS;
+        opt.iterations = 2;
+        WeightedLowess::compute_unsorted(x.size(), rev_x.data(), rev_y.data(), fitted.data(), rweights.data(), opt);
+        EXPECT_EQ(std::vector<double>(fitted.rbegin(), fitted.rend()), ref3.fitted);
+
+        fitted.assign(ref1.fitted.rbegin(), ref1.fitted.rend());
+        opt.warm_start = WeightedLowess::WarmStart::FITTED;
+        opt.iterations = 1;
+        WeightedLowess::compute_unsorted(x.size(), rev_x.data(), rev_y.data(), fitted.data(), static_cast<double*>(NULL), opt);
+        EXPECT_EQ(std::vector<double>(fitted.rbegin(), fitted.rend()), ref3.fitted);
+    }
+}
+
+TEST(ComputeTests, WarmStartErrors) {
+    auto simulated = simulate(101);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+    WeightedLowess::Options opt;
+    opt.warm_start = WeightedLowess::WarmStart::ROBUST_WEIGHTS;
+
+    auto expect_error = [&](auto fun, const std::string& msg) -> void {
+        try {
+            fun();
+            FAIL() << "expected an error";
+        } catch (std::exception& e) {
+            EXPECT_TRUE(std::string(e.what()).find(msg) != std::string::npos) << e.what();
+        }
+    };
+
+    std::vector<double> fitted(x.size());
+    expect_error([&]() -> void { WeightedLowess::compute(x.size(), x.data(), y.data(), fitted.data(), static_cast<double*>(NULL), opt); }, "should be supplied");
+    expect_error([&]() -> void { WeightedLowess::compute(x.size(), x.data(), y.data(), opt); }, "existing results");
+    expect_error([&]() -> void { WeightedLowess::compute_unsorted(x.size(), x.data(), y.data(), opt); }, "existing results");
+
+    WeightedLowess::Results<double> res(0);
+    WeightedLowess::Workspace<double> work;
+    expect_error([&]() -> void { WeightedLowess::compute(x.size(), x.data(), y.data(), opt, res, work); }, "length equal");
+
+    auto win = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    expect_error([&]() -> void { WeightedLowess::compute_batch(x.size(), x.data(), win, 1, y.data(), false, fitted.data(), static_cast<double*>(NULL), opt); }, "not supported");
+}
+
 TEST(ComputeTests, Empty) {
     WeightedLowess::Options opt;
     std::vector<double> x, y;
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include "WeightedLowess/compute_unsorted.hpp"
+#include "WeightedLowess/SortBy.hpp"
+#include "utils.h"
+
+#include <numeric>
+
+class ComputeUnsortedTest : public ::testing::TestWithParam<std::tuple<bool, int> > {};
+
+TEST_P(ComputeUnsortedTest, Reference) {
+    auto param = GetParam();
+    const bool use_weights = std::get<0>(param);
+    const int nthreads = std::get<1>(param);
+
+    auto simulated = simulate(1234, /* sorted = */ false);
+    const auto x = simulated.first;
+    const auto y = simulated.second;
+    std::vector<double> weights(x.size());
+    std::iota(weights.begin(), weights.end(), 1.0);
+
+    WeightedLowess::Options opt;
+    opt.anchors = 100;
+    opt.num_threads = nthreads;
+    if (use_weights) {
+        opt.weights = weights.data();
+    }
+    auto res = WeightedLowess::compute_unsorted(x.size(), x.data(), y.data(), opt);
+
+    // Inputs should not be modified.
+    EXPECT_EQ(x, simulated.first);
+    EXPECT_EQ(y, simulated.second);
+
+    // Comparing to the usual sort/compute/unsort approach.
+    WeightedLowess::SortBy sorter(x.size(), x.data());
+    std::vector<uint8_t> work;
+    auto sx = x, sy = y, sw = weights;
+    sorter.permute({ sx.data(), sy.data(), sw.data() }, work);
+    if (use_weights) {
+        opt.weights = sw.data();
+    }
+    auto ref = WeightedLowess::compute(sx.size(), sx.data(), sy.data(), opt);
+    sorter.unpermute({ ref.fitted.data(), ref.robust_weights.data() }, work);
+    EXPECT_EQ(ref.fitted, res.fitted);
+    EXPECT_EQ(ref.robust_weights, res.robust_weights);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ComputeUnsorted,
+    ComputeUnsortedTest,
+    ::testing::Combine(
+        ::testing::Values(false, true),
+        ::testing::Values(1, 3)
+    )
+);
+
+TEST(ComputeUnsorted, Workspace) {
+    WeightedLowess::Workspace<double> work;
+    WeightedLowess::Options opt;
+
+    for (bool sorted : { false, true, false }) {
+        auto simulated = simulate(500, sorted);
+        const auto& x = simulated.first;
+        const auto& y = simulated.second;
+        auto ref = WeightedLowess::compute_unsorted(x.size(), x.data(), y.data(), opt);
+
+        std::vector<double> fitted(x.size());
+        WeightedLowess::compute_unsorted(x.size(), x.data(), y.data(), fitted.data(), static_cast<double*>(NULL), opt, work);
+        EXPECT_EQ(ref.fitted, fitted);
+    }
+
+    std::vector<double> empty;
+    auto res = WeightedLowess::compute_unsorted(empty.size(), empty.data(), empty.data(), opt);
+    EXPECT_TRUE(res.fitted.empty());
+}
@@ -2,6 +2,11 @@
 #include "WeightedLowess/compute.hpp"
 #include "utils.h"
 
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
 TEST(DivisionByZeroTests, ZeroVariance) {
     // Just large enough that, with the default span, each window contains the
     // centered element and two elements on the boundaries (and thus have zero
@@ -54,3 +59,111 @@ TEST(DivisionByZeroTests, SinglePoint) {
     auto output = WeightedLowess::compute(single.size(), single.data(), single.data(), opt);
     compare_almost_equal(output.fitted, single);
 }
+
+TEST(DivisionByZeroTests, Cancellation) {
+    // If the anchor and its ties have zero robustness weight, the remaining
+    // points are far from the anchor relative to their spread. Here, the
+    // distant point has such a small tricube weight that the one-pass variance
+    // is lost to cancellation, but the true fit is still well-defined.
+    std::vector<double> x{ 0, 0, 0, 1, 1, 1, 1, 1.999999 };
+    std::vector<double> y{ 10, -10, 5, 1, 2, 3, 2, 4 };
+    std::vector<double> zeroed{ 0, 0, 0, 1, 1, 1, 1, 1 };
+    WeightedLowess::internal::Window<double, std::size_t> limits{ 0, 7, 2.0 };
+
+    // Line through the (equally weighted) mean at x = 1 and the point at 1.999999.
+    const double expected = 2 - 2 / 0.999999;
+
+    auto robust = WeightedLowess::internal::fit_point<false, true, double>(1, limits, x.data(), y.data(), static_cast<double*>(NULL), zeroed.data());
+    EXPECT_NEAR(robust, expected, 1e-8);
+
+    auto weighted = WeightedLowess::internal::fit_point<true, false, double>(1, limits, x.data(), y.data(), zeroed.data(), static_cast<double*>(NULL));
+    EXPECT_NEAR(weighted, expected, 1e-8);
+
+    std::array<const double*, 2> yptrs{ y.data(), y.data() };
+    std::vector<double> batched(x.size());
+    std::array<double*, 1> outptrs{ batched.data() };
+    WeightedLowess::internal::fit_point_batch<double>(1, limits, x.data(), yptrs, 1, zeroed.data(), outptrs.data());
+    EXPECT_NEAR(batched[1], expected, 1e-8);
+}
+
+TEST(DivisionByZeroTests, SingleEffectivePoint) {
+    // In the robustness iterations, it is possible for only one point in the
+    // window to have non-zero weight. The centered x-coordinates are subject
+    // to rounding error, which should not be mistaken for a non-zero variance.
+    std::vector<double> x{ 16.4, 16.6, 17.2, 17.6 };
+    std::vector<double> y{ -0.689, 1.446, 0.2303, 31.60 };
+    std::vector<double> robust{ 1, 0, 1, 0 };
+    WeightedLowess::internal::Window<double, std::size_t> limits{ 0, 3, 1.2 };
+    auto fitted = WeightedLowess::internal::fit_point<false, true, double>(3, limits, x.data(), y.data(), static_cast<double*>(NULL), robust.data());
+    EXPECT_DOUBLE_EQ(fitted, 0.2303);
+}
+
+TEST(DivisionByZeroTests, RobustTwoPass) {
+    // Comparing to the classic two-pass formula with robustness weights that
+    // are mostly zero, so that many windows have few (or one) effective x-values.
+    // We use integer x-coordinates so that points on the window boundaries
+    // have exactly zero tricube weight.
+    std::mt19937_64 rng(999);
+    std::uniform_int_distribution<int> xdist(0, 30);
+    std::normal_distribution ndist;
+    std::uniform_real_distribution udist;
+
+    for (int it = 0; it < 50; ++it) {
+        const size_t n = 40;
+        std::vector<double> x(n), y(n), robust(n);
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = xdist(rng) + 100;
+            y[i] = ndist(rng);
+            robust[i] = (udist(rng) < 0.8 ? 0 : udist(rng));
+        }
+        std::sort(x.begin(), x.end());
+
+        WeightedLowess::Options opt;
+        opt.span = 0.2;
+        const auto windows = WeightedLowess::define_windows(n, x.data(), opt);
+
+        for (size_t s = 0; s < windows.anchors.size(); ++s) {
+            const auto curpt = windows.anchors[s];
+            const auto& curlim = windows.limits[s];
+            auto observed = WeightedLowess::internal::fit_point<false, true, double>(curpt, curlim, x.data(), y.data(), static_cast<double*>(NULL), robust.data());
+
+            std::vector<double> w(n);
+            double sumw = 0, xmean = 0, ymean = 0;
+            for (auto pt = curlim.left; pt <= curlim.right; ++pt) {
+                if (curlim.distance > 0) {
+                    w[pt] = WeightedLowess::internal::tricube(x[pt] - x[curpt], curlim.distance);
+                } else {
+                    w[pt] = 1;
+                }
+                w[pt] *= robust[pt];
+                sumw += w[pt];
+                xmean += w[pt] * x[pt];
+                ymean += w[pt] * y[pt];
+            }
+            if (sumw == 0) {
+                continue; // ignoring robustness weights is tested elsewhere.
+            }
+            xmean /= sumw;
+            ymean /= sumw;
+
+            // Checking for a single distinct x-value explicitly.
+            std::vector<double> distinct;
+            for (auto pt = curlim.left; pt <= curlim.right; ++pt) {
+                if (w[pt] > 0) {
+                    distinct.push_back(x[pt]);
+                }
+            }
+            double expected = ymean;
+            if (std::adjacent_find(distinct.begin(), distinct.end(), std::not_equal_to<double>()) != distinct.end()) {
+                double var = 0, covar = 0;
+                for (auto pt = curlim.left; pt <= curlim.right; ++pt) {
+                    var += w[pt] * (x[pt] - xmean) * (x[pt] - xmean);
+                    covar += w[pt] * (x[pt] - xmean) * (y[pt] - ymean);
+                }
+                expected = ymean + covar / var * (x[curpt] - xmean);
+            }
+
+            EXPECT_NEAR(observed, expected, 1e-8 * (1 + std::abs(expected)));
+        }
+    }
+}
@@ -140,3 +140,45 @@ TEST(Interpolate, Ties) {
         EXPECT_FLOAT_EQ(ix, 3.5);
     }
 }
+
+TEST(Interpolate, Clustered) {
+    // Most of the points lie in a couple of segments, so that threads have to
+    // split segments to get an even share of the points.
+    const int N = 1000;
+    auto simulated = simulate(N);
+    const auto& x = simulated.first;
+    WeightedLowess::Options opt;
+    opt.anchors = 20;
+
+    const auto win = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    std::vector<double> fitted(N);
+    WeightedLowess::compute(x.size(), x.data(), win, simulated.second.data(), fitted.data(), static_cast<double*>(NULL), opt);
+
+    std::vector<double> newx;
+    const auto left = x[win.anchors[3]], right = x[win.anchors[5]];
+    for (int i = 0; i < 5000; ++i) {
+        newx.push_back(left + (right - left) * i / 5000.0);
+    }
+    newx.push_back(x.back());
+
+    std::vector<double> ref(newx.size());
+    WeightedLowess::interpolate(x.data(), win, fitted.data(), newx.size(), newx.data(), ref.data(), 1);
+    for (int nthreads : { 2, 3, 7, 10000 }) {
+        std::vector<double> par(newx.size());
+        WeightedLowess::interpolate(x.data(), win, fitted.data(), newx.size(), newx.data(), par.data(), nthreads);
+        EXPECT_EQ(ref, par);
+    }
+
+    // Same for the interpolation in compute() itself, where all points lie in a single segment.
+    std::vector<double> cx(N);
+    for (int i = 0; i < N; ++i) {
+        cx[i] = (i < N - 1 ? i / static_cast<double>(N) : 100);
+    }
+    opt.delta = 50;
+    auto cres = WeightedLowess::compute(cx.size(), cx.data(), simulated.second.data(), opt);
+    for (int nthreads : { 2, 3, 7 }) {
+        opt.num_threads = nthreads;
+        auto pres = WeightedLowess::compute(cx.size(), cx.data(), simulated.second.data(), opt);
+        EXPECT_EQ(cres.fitted, pres.fitted);
+    }
+}
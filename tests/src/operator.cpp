@@ -0,0 +1,241 @@
+#include <gtest/gtest.h>
+#include "WeightedLowess/operator.hpp"
+#include "WeightedLowess/compute.hpp"
+#include "utils.h"
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+class OperatorTest : public ::testing::TestWithParam<int> {
+protected:
+    static void compare(const std::vector<double>& ref, const std::vector<double>& obs) {
+        ASSERT_EQ(ref.size(), obs.size());
+        for (size_t i = 0; i < ref.size(); ++i) {
+            EXPECT_NEAR(ref[i], obs[i], 1e-8);
+        }
+    }
+};
+
+TEST_P(OperatorTest, Consistency) {
+    auto simulated = simulate(800);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+
+    WeightedLowess::Options opt;
+    opt.anchors = GetParam();
+    opt.iterations = 0;
+
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), windows, opt);
+
+    std::vector<double> ref(x.size());
+    WeightedLowess::compute(x.size(), x.data(), windows, y.data(), ref.data(), static_cast<double*>(NULL), opt);
+
+    std::vector<double> obs(x.size());
+    WeightedLowess::apply_operator(op, y.data(), obs.data(), 1);
+    compare(ref, obs);
+
+    std::vector<double> pobs(x.size());
+    WeightedLowess::apply_operator(op, y.data(), pobs.data(), 3);
+    EXPECT_EQ(obs, pobs);
+
+    // Works for a straight line.
+    WeightedLowess::apply_operator(op, x.data(), obs.data(), 1);
+    compare(x, obs);
+}
+
+TEST_P(OperatorTest, Weighted) {
+    auto simulated = simulate(600);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+
+    std::vector<double> weights(x.size());
+    std::mt19937_64 rng(100);
+    std::uniform_real_distribution udist;
+    for (auto& w : weights) {
+        w = udist(rng);
+    }
+
+    WeightedLowess::Options opt;
+    opt.anchors = GetParam();
+    opt.iterations = 0;
+    opt.weights = weights.data();
+
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), windows, opt);
+
+    std::vector<double> ref(x.size());
+    WeightedLowess::compute(x.size(), x.data(), windows, y.data(), ref.data(), static_cast<double*>(NULL), opt);
+    std::vector<double> obs(x.size());
+    WeightedLowess::apply_operator(op, y.data(), obs.data(), 2);
+    compare(ref, obs);
+}
+
+TEST_P(OperatorTest, Matrix) {
+    auto simulated = simulate(500);
+    const auto& x = simulated.first;
+
+    WeightedLowess::Options opt;
+    opt.anchors = GetParam();
+    opt.iterations = 0;
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), windows, opt);
+
+    const size_t nc = 5;
+    std::vector<double> y(x.size() * nc);
+    std::mt19937_64 rng(200);
+    std::normal_distribution ndist;
+    for (auto& yy : y) {
+        yy = ndist(rng);
+    }
+
+    std::vector<double> fitted(y.size());
+    WeightedLowess::apply_operator(op, nc, y.data(), fitted.data(), 2);
+    for (size_t c = 0; c < nc; ++c) {
+        std::vector<double> obs(x.size());
+        WeightedLowess::apply_operator(op, y.data() + c * x.size(), obs.data(), 1);
+        EXPECT_EQ(obs, std::vector<double>(fitted.begin() + c * x.size(), fitted.begin() + (c + 1) * x.size()));
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Operator,
+    OperatorTest,
+    ::testing::Values(10, 50, 200, 1000)
+);
+
+TEST(Operator, Ties) {
+    // Same as the tied interpolation test in compute.cpp.
+    std::vector<double> x { 0., 0., 0., 0., 0., 0. };
+    std::vector<double> y { 1., 2., 3., 4., 5., 6. };
+
+    WeightedLowess::PrecomputedWindows<double> win;
+    win.anchors.push_back(0);
+    win.anchors.push_back(x.size() - 1);
+    win.freq_weights = NULL;
+    win.total_weight = x.size();
+
+    win.limits.resize(2);
+    win.limits.front().left = 0;
+    win.limits.front().right = 2;
+    win.limits.front().distance = 0;
+    win.limits.back().left = 3;
+    win.limits.back().right = 5;
+    win.limits.back().distance = 0;
+
+    WeightedLowess::Options opt;
+    opt.iterations = 0;
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), win, opt);
+    std::vector<double> fitted(x.size());
+    WeightedLowess::apply_operator(op, y.data(), fitted.data(), 1);
+
+    EXPECT_FLOAT_EQ(fitted[0], 2.0);
+    for (int i = 1; i < 4; ++i) {
+        EXPECT_FLOAT_EQ(fitted[i], 3.5);
+    }
+    EXPECT_FLOAT_EQ(fitted[5], 5.0);
+}
+
+TEST(Operator, Empty) {
+    WeightedLowess::Options opt;
+    opt.iterations = 0;
+    std::vector<double> x;
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), windows, opt);
+    std::vector<double> fitted;
+    WeightedLowess::apply_operator(op, x.data(), fitted.data(), 1);
+    EXPECT_TRUE(op.anchors.empty());
+}
+
+TEST(Operator, Errors) {
+    auto simulated = simulate(50);
+    const auto& x = simulated.first;
+    WeightedLowess::Options opt;
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+
+    auto expect_error = [&](const std::string& msg) -> void {
+        try {
+            WeightedLowess::define_operator(x.size(), x.data(), windows, opt);
+            FAIL() << "expected an error";
+        } catch (std::exception& e) {
+            EXPECT_TRUE(std::string(e.what()).find(msg) != std::string::npos) << e.what();
+        }
+    };
+
+    expect_error("robustness iterations");
+    opt.iterations = 0;
+    opt.warm_start = WeightedLowess::WarmStart::FITTED;
+    expect_error("warm starts");
+}
+
+TEST(Operator, Cancellation) {
+    // Same as the cancellation test in divzero.cpp, where the anchor and its
+    // ties have zero weight and the one-pass variance is lost to cancellation.
+    std::vector<double> x{ 0, 0, 0, 1, 1, 1, 1, 1.999999 };
+    std::vector<double> y{ 10, -10, 5, 1, 2, 3, 2, 4 };
+    std::vector<double> weights{ 0, 0, 0, 1, 1, 1, 1, 1 };
+
+    WeightedLowess::PrecomputedWindows<double> win;
+    win.anchors = std::vector<size_t>{ 0, 1, 7 };
+    win.freq_weights = NULL;
+    win.total_weight = x.size();
+    win.limits.resize(3, WeightedLowess::internal::Window<double>{ 0, 7, 2.0 });
+
+    WeightedLowess::Options opt;
+    opt.iterations = 0;
+    opt.weights = weights.data();
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), win, opt);
+    std::vector<double> fitted(x.size());
+    WeightedLowess::apply_operator(op, y.data(), fitted.data(), 1);
+
+    const double expected = 2 - 2 / 0.999999;
+    EXPECT_NEAR(fitted[1], expected, 1e-8);
+    const double direct = WeightedLowess::internal::fit_point<true, false, double>(1, win.limits[1], x.data(), y.data(), weights.data(), static_cast<double*>(NULL));
+    EXPECT_NEAR(fitted[1], direct, 1e-8);
+}
+
+TEST(Operator, Accumulate) {
+    auto simulated = simulate(5000);
+    std::vector<float> x(simulated.first.begin(), simulated.first.end());
+    std::vector<float> y(simulated.second.begin(), simulated.second.end());
+    for (auto& val : y) {
+        val += 1000; // large offset so that summing in float would lose precision.
+    }
+
+    WeightedLowess::Options<float, double> opt;
+    opt.anchors = 50;
+    opt.iterations = 0;
+    const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto op = WeightedLowess::define_operator(x.size(), x.data(), windows, opt);
+
+    std::vector<float> ref(x.size());
+    WeightedLowess::compute(x.size(), x.data(), windows, y.data(), ref.data(), static_cast<float*>(NULL), opt);
+    std::vector<float> obs(x.size());
+    WeightedLowess::apply_operator(op, y.data(), obs.data(), 1);
+
+    // Both are accumulated in double, so they should only differ by the final rounding to float.
+    for (size_t i = 0; i < x.size(); ++i) {
+        EXPECT_NEAR(ref[i], obs[i], std::abs(ref[i]) * std::numeric_limits<float>::epsilon() * 2);
+    }
+}
+
+TEST(Operator, SmallIndex) {
+    auto simulated = simulate(1001);
+    const auto& x = simulated.first;
+    const auto& y = simulated.second;
+
+    WeightedLowess::Options opt;
+    opt.anchors = 97;
+    opt.iterations = 0;
+    const auto ref_win = WeightedLowess::define_windows(x.size(), x.data(), opt);
+    const auto ref_op = WeightedLowess::define_operator(x.size(), x.data(), ref_win, opt);
+    std::vector<double> ref(x.size());
+    WeightedLowess::apply_operator(ref_op, y.data(), ref.data(), 1);
+
+    const auto win = WeightedLowess::define_windows<double, std::uint32_t>(x.size(), x.data(), opt);
+    const WeightedLowess::SmoothingOperator<double, std::uint32_t> op = WeightedLowess::define_operator(x.size(), x.data(), win, opt);
+    std::vector<double> obs(x.size());
+    WeightedLowess::apply_operator(op, y.data(), obs.data(), 2);
+    EXPECT_EQ(ref, obs);
+}
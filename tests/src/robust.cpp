@@ -2,6 +2,10 @@
 #include "WeightedLowess/robust.hpp"
 #include "utils.h"
 
+#include <numeric>
+#include <random>
+#include <algorithm>
+
 TEST(RobustTest, BasicMad) {
     std::vector<double> resids { 0.5, 0.2, -1, 1.5, -2 };
     std::vector<double> fitted(resids.size()), y(resids.size());
@@ -10,10 +14,10 @@ TEST(RobustTest, BasicMad) {
         y[i] = i + resids[i];
     }
 
-    std::vector<double> abs_dev;
+    std::vector<double> abs_dev, values;
     std::vector<size_t> perm;
     { 
-        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), static_cast<double*>(NULL), static_cast<double>(resids.size()), abs_dev, perm);
+        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), static_cast<double*>(NULL), static_cast<double>(resids.size()), abs_dev, values, perm);
         EXPECT_FLOAT_EQ(cmad, 1);
         for (size_t i = 0; i < resids.size(); ++i) {
             EXPECT_FLOAT_EQ(abs_dev[i], std::abs(resids[i]));
@@ -25,7 +29,7 @@ TEST(RobustTest, BasicMad) {
     fitted.push_back(10);
     y.push_back(resids.back() + 10);
     { 
-        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), static_cast<double*>(NULL), static_cast<double>(resids.size()), abs_dev, perm);
+        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), static_cast<double*>(NULL), static_cast<double>(resids.size()), abs_dev, values, perm);
         EXPECT_FLOAT_EQ(cmad, 0.75);
         for (size_t i = 0; i < resids.size(); ++i) {
             EXPECT_FLOAT_EQ(abs_dev[i], std::abs(resids[i]));
@@ -41,23 +45,72 @@ TEST(RobustTest, WeightedMad) {
         y[i] = i + resids[i];
     }
 
-    std::vector<double> abs_dev;
+    std::vector<double> abs_dev, values;
     std::vector<size_t> perm;
     {
         std::vector<double> weights { 1, 5, 1, 1, 1 };
         auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
-        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), weights.data(), total, abs_dev, perm);
+        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), weights.data(), total, abs_dev, values, perm);
         EXPECT_FLOAT_EQ(cmad, 0.2);
     }
 
     {
         std::vector<double> weights { 2, 1, 1, 1, 1 };
         auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
-        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), weights.data(), total, abs_dev, perm);
+        auto cmad = WeightedLowess::internal::compute_mad(y.size(), y.data(), fitted.data(), weights.data(), total, abs_dev, values, perm);
         EXPECT_FLOAT_EQ(cmad, 0.75);
     }
 }
 
+static double reference_mad(const std::vector<double>& abs_dev, const std::vector<double>& weights) {
+    std::vector<size_t> perm(abs_dev.size());
+    std::iota(perm.begin(), perm.end(), 0);
+    std::sort(perm.begin(), perm.end(), [&](size_t l, size_t r) -> bool { return abs_dev[l] < abs_dev[r]; });
+
+    double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+    double cumulative = 0;
+    for (size_t i = 0; i < perm.size(); ++i) {
+        cumulative += weights[perm[i]];
+        if (cumulative == total / 2) {
+            return (abs_dev[perm[i]] + abs_dev[perm[i + 1]]) / 2;
+        } else if (cumulative > total / 2) {
+            return abs_dev[perm[i]];
+        }
+    }
+    return 0;
+}
+
+TEST(RobustTest, SelectionMad) {
+    std::mt19937_64 rng(42);
+    std::vector<double> abs_dev, values;
+    std::vector<size_t> perm;
+
+    for (size_t n : { 1, 2, 7, 20, 33, 64, 101, 1000, 1001 }) {
+        // Using rounded values and integer weights to get plenty of ties and exact halves.
+        std::vector<double> y(n), fitted(n), weights(n);
+        std::uniform_int_distribution<int> vdist(0, 20), wdist(0, 3);
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = vdist(rng);
+            weights[i] = wdist(rng);
+        }
+        weights[0] = 1; // make sure there's at least one positive weight.
+
+        std::vector<double> expected_abs_dev(y);
+        std::vector<double> ones(n, 1);
+        auto cmad = WeightedLowess::internal::compute_mad(n, y.data(), fitted.data(), static_cast<double*>(NULL), static_cast<double>(n), abs_dev, values, perm, 3);
+        EXPECT_EQ(abs_dev, expected_abs_dev);
+        EXPECT_EQ(cmad, reference_mad(expected_abs_dev, ones));
+
+        auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
+        auto wmad = WeightedLowess::internal::compute_mad(n, y.data(), fitted.data(), weights.data(), total, abs_dev, values, perm);
+        EXPECT_EQ(wmad, reference_mad(expected_abs_dev, weights));
+
+        // Checking that we are in the weighted code path with uniform weights.
+        auto umad = WeightedLowess::internal::compute_mad(n, y.data(), fitted.data(), ones.data(), static_cast<double>(n), abs_dev, values, perm);
+        EXPECT_EQ(umad, cmad);
+    }
+}
+
 TEST(RobustTest, ZeroWeights) {
     {
         std::vector<double> weights { 0, 1, 0, 0, 1 };
@@ -2,6 +2,11 @@
 #include "WeightedLowess/window.hpp"
 #include "utils.h"
 
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+
 TEST(WindowTest, DeriveDelta) {
     std::vector<double> pts { 1, 2.5, 5, 6.2, 9, 10 };
 
@@ -30,6 +35,97 @@ TEST(WindowTest, DeriveDelta) {
     }
 }
 
+// Full sort and cumulative sum, as a reference. This uses either a naive sum
+// or a compensated sum, the latter being the same as derive_delta().
+static double reference_delta(const std::vector<double>& pts, size_t num_anchors, bool compensated) {
+    const size_t n = pts.size();
+    std::vector<double> diffs(n - 1);
+    for (size_t i = 1; i < n; ++i) {
+        diffs[i - 1] = pts[i] - pts[i - 1];
+    }
+    std::sort(diffs.begin(), diffs.end());
+
+    if (compensated) {
+        WeightedLowess::internal::CompensatedSum<double> sum;
+        for (auto& d : diffs) {
+            sum.add(d);
+            d = sum.get();
+        }
+    } else {
+        std::partial_sum(diffs.begin(), diffs.end(), diffs.begin());
+    }
+
+    double expected = diffs.back();
+    for (size_t nskips = 0; nskips < std::min(num_anchors - 1, n - 1); ++nskips) {
+        expected = std::min(expected, diffs[n - nskips - 2] / (num_anchors - nskips));
+    }
+    return expected;
+}
+
+TEST(WindowTest, DeriveDeltaReference) {
+    auto sim = simulate(200000);
+    const auto& pts = sim.first;
+    const size_t n = pts.size();
+
+    std::vector<double> buffer;
+    for (size_t num_anchors : { 1, 2, 10, 200, 5000 }) {
+        auto observed = WeightedLowess::internal::derive_delta(num_anchors, n, pts.data(), buffer);
+        EXPECT_EQ(reference_delta(pts, num_anchors, true), observed);
+        EXPECT_EQ(observed, WeightedLowess::internal::derive_delta(num_anchors, n, pts.data(), buffer, 3));
+
+        // Only differs from the naive sum by rounding error.
+        const double naive = reference_delta(pts, num_anchors, false);
+        EXPECT_NEAR(naive, observed, 1e-12 * naive);
+    }
+
+    // Checking that the sum is independent of the number of threads.
+    auto total = WeightedLowess::internal::parallel_sum(pts.size(), pts.data(), 1);
+    EXPECT_EQ(total, WeightedLowess::internal::parallel_sum(pts.size(), pts.data(), 2));
+    EXPECT_EQ(total, WeightedLowess::internal::parallel_sum(pts.size(), pts.data(), 5));
+
+    // Checking that the compensated sum is more or less independent of the order.
+    auto reversed = pts;
+    std::reverse(reversed.begin(), reversed.end());
+    EXPECT_NEAR(total, WeightedLowess::internal::parallel_sum(reversed.size(), reversed.data(), 1), 1e-12);
+}
+
+TEST(WindowTest, DeriveDeltaQuantized) {
+    // Gaps on a grid are only equal up to rounding error, so the delta (and
+    // thus the anchors) depend on how the gaps are summed. We check that we
+    // get exactly the same delta and anchors as the compensated sum of the
+    // fully sorted gaps, regardless of the order left by the partial sort.
+    // Compared to the naive sum, the delta only differs by the accumulated
+    // rounding error of the latter.
+    std::mt19937_64 rng(4242);
+    std::normal_distribution ndist;
+
+    for (size_t n : { 50, 332, 1000, 10000 }) {
+        for (double scale : { 10.0, 100.0 }) {
+            std::vector<double> pts(n);
+            for (auto& p : pts) {
+                p = std::floor(scale * ndist(rng)) / scale;
+            }
+            std::sort(pts.begin(), pts.end());
+
+            std::vector<double> buffer;
+            for (size_t num_anchors : { 2, 4, 20, 100 }) {
+                const double expected = reference_delta(pts, num_anchors, true);
+                std::vector<size_t> expected_anchors;
+                WeightedLowess::internal::find_anchors(n, pts.data(), expected, expected_anchors);
+
+                auto observed = WeightedLowess::internal::derive_delta(num_anchors, n, pts.data(), buffer, 2);
+                EXPECT_EQ(expected, observed);
+                std::vector<size_t> observed_anchors;
+                WeightedLowess::internal::find_anchors(n, pts.data(), observed, observed_anchors);
+                EXPECT_EQ(expected_anchors, observed_anchors);
+
+                const double naive = reference_delta(pts, num_anchors, false);
+                EXPECT_NEAR(naive, observed, 1e-12 * naive);
+            }
+        }
+    }
+}
+
 TEST(WindowTest, FindAnchors) {
     std::vector<double> pts { 1, 2.5, 5, 6.2, 9, 10 };
 
@@ -62,6 +158,84 @@ TEST(WindowTest, FindAnchors) {
     }
 }
 
+TEST(WindowTest, FindAnchorsParallel) {
+    std::mt19937_64 rng(789);
+    std::uniform_int_distribution<int> dist(0, 1000);
+
+    for (size_t n : { 1, 2, 3, 10, 100, 10000 }) {
+        for (bool tied : { false, true }) {
+            std::vector<double> pts(n);
+            if (tied) {
+                for (auto& p : pts) {
+                    p = dist(rng);
+                }
+                std::sort(pts.begin(), pts.end());
+            } else {
+                pts = simulate(n).first;
+            }
+
+            for (double delta : { 0.001, 0.1, 1.0, 10.0, 1000.0 }) {
+                // Reference implementation with a simple walk.
+                std::vector<size_t> expected { 0 };
+                for (size_t i = 1; i + 1 < n; ++i) {
+                    if (pts[i] - pts[expected.back()] > delta) {
+                        expected.push_back(i);
+                    }
+                }
+                expected.push_back(n - 1);
+
+                for (int nthreads : { 1, 2, 3, 7 }) {
+                    std::vector<size_t> observed;
+                    WeightedLowess::internal::find_anchors(n, pts.data(), delta, observed, nthreads);
+                    EXPECT_EQ(expected, observed);
+                }
+            }
+        }
+    }
+}
+
+TEST(WindowTest, IsSortedParallel) {
+    auto pts = simulate(1000).first;
+    for (int nthreads : { 1, 2, 3, 7 }) {
+        EXPECT_TRUE(WeightedLowess::internal::parallel_is_sorted(pts.size(), pts.data(), nthreads));
+    }
+
+    // Checking that chunk boundaries are handled correctly.
+    for (size_t i = 1; i < pts.size(); i += 37) {
+        auto copy = pts;
+        copy[i] = copy[i - 1] - 1;
+        for (int nthreads : { 1, 2, 3, 7 }) {
+            EXPECT_FALSE(WeightedLowess::internal::parallel_is_sorted(copy.size(), copy.data(), nthreads));
+        }
+    }
+}
+
+TEST(WindowTest, FindGridStep) {
+    std::vector<double> grid(1000);
+    for (size_t i = 0; i < grid.size(); ++i) {
+        grid[i] = 100 + i * 0.1;
+    }
+    for (int nthreads : { 1, 2, 3, 7 }) {
+        auto step = WeightedLowess::internal::find_grid_step(grid.size(), grid.data(), nthreads);
+        ASSERT_TRUE(step.has_value());
+        EXPECT_FLOAT_EQ(*step, 0.1);
+    }
+
+    // Checking that chunk boundaries are handled correctly.
+    for (size_t i = 1; i < grid.size(); i += 37) {
+        auto copy = grid;
+        copy[i] += 0.01;
+        for (int nthreads : { 1, 2, 3, 7 }) {
+            EXPECT_FALSE(WeightedLowess::internal::find_grid_step(copy.size(), copy.data(), nthreads).has_value());
+        }
+    }
+
+    // Not a grid if all points are the same, or there are too few points.
+    std::vector<double> same(10, 1.0);
+    EXPECT_FALSE(WeightedLowess::internal::find_grid_step(same.size(), same.data(), 1).has_value());
+    EXPECT_FALSE(WeightedLowess::internal::find_grid_step(2, grid.data(), 1).has_value());
+}
+
 TEST(WindowTest, FindLimitsBasic) {
     std::vector<double> pts { 1, 2.5, 5, 6.2, 9, 10 };
     auto limiters = WeightedLowess::internal::find_limits({ 0, 1, 2, 3, 4, 5 }, 4.0, pts.size(), pts.data(), static_cast<double*>(NULL), 0.0);
@@ -214,6 +388,208 @@ TEST(WindowTest, Parallelized) {
     }
 }
 
+TEST(WindowTest, SlidingLimits) {
+    // Checking that the sliding window gives the same results as the expansion,
+    // using rounded values to get plenty of ties on either side of each anchor.
+    std::mt19937_64 rng(123);
+    std::uniform_int_distribution<int> dist(0, 50);
+
+    for (size_t n : { 1, 2, 5, 20, 100, 1000 }) {
+        std::vector<double> pts(n);
+        for (auto& p : pts) {
+            p = dist(rng);
+        }
+        std::sort(pts.begin(), pts.end());
+        WeightedLowess::internal::TieIndex ties;
+        WeightedLowess::internal::build_tie_index(n, pts.data(), ties);
+
+        std::vector<size_t> anchors(n);
+        std::iota(anchors.begin(), anchors.end(), 0);
+        std::vector<size_t> sub_anchors;
+        for (size_t i = 0; i < n; i += 7) {
+            sub_anchors.push_back(i);
+        }
+        std::vector<size_t> boundaries;
+
+        for (double span : { 0.5, 1.0, 2.0, 3.5, 10.0, 51.0, 200.0, 5000.0 }) {
+            for (double min_width : { 0.0, 5.0 }) {
+                for (const auto& curanchors : { anchors, sub_anchors }) {
+                    std::vector<WeightedLowess::internal::Window<double> > expected(curanchors.size()), observed(curanchors.size()), indexed(curanchors.size());
+                    WeightedLowess::internal::expand_limits<false>(curanchors, span, n, pts.data(), static_cast<double*>(NULL), WeightedLowess::internal::TieIndex(), min_width, 1, expected, boundaries);
+                    WeightedLowess::internal::slide_limits(curanchors, span, n, pts.data(), WeightedLowess::internal::TieIndex(), min_width, 2, observed, boundaries);
+                    WeightedLowess::internal::slide_limits(curanchors, span, n, pts.data(), ties, min_width, 2, indexed, boundaries);
+
+                    for (size_t i = 0; i < curanchors.size(); ++i) {
+                        EXPECT_EQ(expected[i].left, observed[i].left);
+                        EXPECT_EQ(expected[i].right, observed[i].right);
+                        EXPECT_EQ(expected[i].distance, observed[i].distance);
+                        EXPECT_EQ(expected[i].left, indexed[i].left);
+                        EXPECT_EQ(expected[i].right, indexed[i].right);
+                        EXPECT_EQ(expected[i].distance, indexed[i].distance);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(WindowTest, SearchLimits) {
+    // Checking that the prefix sum search gives the same results as the
+    // expansion. We use integer weights so that the window weights are exact.
+    std::mt19937_64 rng(456);
+    std::uniform_int_distribution<int> dist(0, 50), wdist(0, 4);
+
+    for (size_t n : { 1, 2, 5, 20, 100, 1000 }) {
+        std::vector<double> pts(n), weights(n);
+        for (size_t i = 0; i < n; ++i) {
+            pts[i] = dist(rng);
+            weights[i] = wdist(rng);
+        }
+        std::sort(pts.begin(), pts.end());
+        WeightedLowess::internal::TieIndex ties;
+        WeightedLowess::internal::build_tie_index(n, pts.data(), ties);
+        double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+        std::vector<size_t> anchors(n);
+        std::iota(anchors.begin(), anchors.end(), 0);
+
+        for (double span : { 0.0, 1.0, 2.5, 10.0, 51.0, 200.0, total, total + 1 }) {
+            for (double min_width : { 0.0, 5.0 }) {
+                std::vector<WeightedLowess::internal::Window<double> > expected(n), observed(n), parallel(n);
+                std::vector<double> buffer;
+                std::vector<size_t> boundaries;
+                WeightedLowess::internal::expand_limits<true>(anchors, span, n, pts.data(), weights.data(), WeightedLowess::internal::TieIndex(), min_width, 1, expected, boundaries);
+                WeightedLowess::internal::search_limits(anchors, span, n, pts.data(), weights.data(), ties, min_width, 2, observed, buffer);
+                WeightedLowess::internal::expand_limits<true>(anchors, span, n, pts.data(), weights.data(), ties, min_width, 3, parallel, boundaries);
+
+                for (size_t i = 0; i < n; ++i) {
+                    EXPECT_EQ(expected[i].left, observed[i].left);
+                    EXPECT_EQ(expected[i].right, observed[i].right);
+                    EXPECT_EQ(expected[i].distance, observed[i].distance);
+                    EXPECT_EQ(expected[i].left, parallel[i].left);
+                    EXPECT_EQ(expected[i].right, parallel[i].right);
+                    EXPECT_EQ(expected[i].distance, parallel[i].distance);
+                }
+
+                // Default is to use the expansion.
+                auto defaults = WeightedLowess::internal::find_limits(anchors, span, n, pts.data(), weights.data(), min_width, 2);
+                auto searched = WeightedLowess::internal::find_limits(anchors, span, n, pts.data(), weights.data(), min_width, 2, true);
+                for (size_t i = 0; i < n; ++i) {
+                    EXPECT_EQ(expected[i].left, defaults[i].left);
+                    EXPECT_EQ(expected[i].right, defaults[i].right);
+                    EXPECT_EQ(expected[i].left, searched[i].left);
+                    EXPECT_EQ(expected[i].right, searched[i].right);
+                }
+            }
+        }
+    }
+}
+
+TEST(WindowTest, SearchLimitsFloat) {
+    // Large odd weights are not exactly representable in a float prefix sum
+    // once it exceeds 2^24, so we check that the prefix sum is accumulated in
+    // higher precision. The window weights themselves are still exact.
+    const size_t n = 2000;
+    std::vector<float> pts(n), weights(n, 10001);
+    std::iota(pts.begin(), pts.end(), 0);
+    WeightedLowess::internal::TieIndex ties;
+    WeightedLowess::internal::build_tie_index(n, pts.data(), ties);
+
+    std::vector<size_t> anchors(n);
+    std::iota(anchors.begin(), anchors.end(), 0);
+
+    for (float span : { 10001.0f * 7, 10001.0f * 50, 10001.0f * 301 }) {
+        std::vector<WeightedLowess::internal::Window<float> > expected(n), observed(n);
+        std::vector<double> buffer;
+        std::vector<size_t> boundaries;
+        WeightedLowess::internal::expand_limits<true>(anchors, span, n, pts.data(), weights.data(), WeightedLowess::internal::TieIndex(), 0.0f, 1, expected, boundaries);
+        WeightedLowess::internal::search_limits(anchors, span, n, pts.data(), weights.data(), ties, 0.0f, 1, observed, buffer);
+
+        for (size_t i = 0; i < n; ++i) {
+            EXPECT_EQ(expected[i].left, observed[i].left);
+            EXPECT_EQ(expected[i].right, observed[i].right);
+            EXPECT_EQ(expected[i].distance, observed[i].distance);
+        }
+    }
+}
+
+TEST(WindowTest, TieIndex) {
+    std::vector<double> pts { 1, 1, 2, 3, 3, 3, 4, 5, 5 };
+    WeightedLowess::internal::TieIndex ties;
+    WeightedLowess::internal::build_tie_index(pts.size(), pts.data(), ties);
+    EXPECT_EQ(ties.run_starts, std::vector<size_t>({ 0, 2, 3, 6, 7, 9 }));
+    EXPECT_EQ(WeightedLowess::internal::run_first(ties, 4), 3);
+    EXPECT_EQ(WeightedLowess::internal::run_last(ties, 4), 5);
+    EXPECT_EQ(WeightedLowess::internal::run_first(ties, 2), 2);
+    EXPECT_EQ(WeightedLowess::internal::run_last(ties, 2), 2);
+    EXPECT_EQ(WeightedLowess::internal::run_last(ties, 8), 8);
+
+    // Same results with multiple threads.
+    {
+        WeightedLowess::internal::TieIndex pties;
+        WeightedLowess::internal::build_tie_index(pts.size(), pts.data(), pties, 4);
+        EXPECT_EQ(ties.run_ids, pties.run_ids);
+        EXPECT_EQ(ties.run_starts, pties.run_starts);
+    }
+
+    // Nothing is stored without ties.
+    std::vector<double> unique { 1, 2, 3 };
+    WeightedLowess::internal::build_tie_index(unique.size(), unique.data(), ties);
+    EXPECT_TRUE(ties.run_ids.empty());
+    EXPECT_TRUE(ties.run_starts.empty());
+
+    // Windows for tied anchors are the same as if each anchor was considered separately.
+    std::vector<size_t> anchors(pts.size());
+    std::iota(anchors.begin(), anchors.end(), 0);
+    auto limiters = WeightedLowess::internal::find_limits(anchors, 3.0, pts.size(), pts.data(), static_cast<double*>(NULL), 0.0);
+    for (size_t a = 0; a < anchors.size(); ++a) {
+        auto single = WeightedLowess::internal::find_limits({ a }, 3.0, pts.size(), pts.data(), static_cast<double*>(NULL), 0.0);
+        EXPECT_EQ(limiters[a].left, single[0].left);
+        EXPECT_EQ(limiters[a].right, single[0].right);
+        EXPECT_EQ(limiters[a].distance, single[0].distance);
+    }
+}
+
+TEST(WindowTest, PartitionByCost) {
+    std::vector<std::size_t> boundaries;
+
+    // Uniform costs give the usual equal-sized ranges.
+    WeightedLowess::internal::partition_by_cost(12, 3, [](std::size_t) -> std::size_t { return 1; }, boundaries);
+    EXPECT_EQ(boundaries, std::vector<std::size_t>({ 0, 4, 8, 12 }));
+
+    // Expensive tasks get their own ranges.
+    std::vector<std::size_t> costs { 100, 1, 1, 1, 1, 1, 1, 1, 1, 100 };
+    WeightedLowess::internal::partition_by_cost(costs.size(), 2, [&](std::size_t i) -> std::size_t { return costs[i]; }, boundaries);
+    EXPECT_EQ(boundaries, std::vector<std::size_t>({ 0, 5, 10 }));
+    WeightedLowess::internal::partition_by_cost(costs.size(), 3, [&](std::size_t i) -> std::size_t { return costs[i]; }, boundaries);
+    EXPECT_EQ(boundaries, std::vector<std::size_t>({ 0, 1, 9, 10 }));
+
+    // Ranges are always contiguous and cover all tasks.
+    std::mt19937_64 rng(42);
+    std::vector<std::size_t> random_costs(1000);
+    for (auto& c : random_costs) {
+        c = rng() % 1000;
+    }
+    for (int nthreads : { 1, 2, 7, 2000 }) {
+        WeightedLowess::internal::partition_by_cost(random_costs.size(), nthreads, [&](std::size_t i) -> std::size_t { return random_costs[i]; }, boundaries);
+        EXPECT_EQ(boundaries.size(), std::min<std::size_t>(nthreads, random_costs.size()) + 1);
+        EXPECT_EQ(boundaries.front(), 0);
+        EXPECT_EQ(boundaries.back(), random_costs.size());
+        EXPECT_TRUE(std::is_sorted(boundaries.begin(), boundaries.end()));
+
+        std::vector<int> visited(random_costs.size());
+        WeightedLowess::internal::parallelize_partition(nthreads, boundaries, [&](std::size_t start, std::size_t end) {
+            for (auto i = start; i < end; ++i) {
+                ++visited[i];
+            }
+        });
+        EXPECT_EQ(visited, std::vector<int>(random_costs.size(), 1));
+    }
+
+    WeightedLowess::internal::partition_by_cost(0, 4, [](std::size_t) -> std::size_t { return 1; }, boundaries);
+    EXPECT_EQ(boundaries, std::vector<std::size_t>({ 0, 0 }));
+}
+
 TEST(WindowTest, Overall) {
     std::vector<double> x{ 0.1, 0.11, 0.17, 0.2, 0.24, 0.3, 0.4, 0.42, 0.44, 0.45, 0.5, 0.9 };
     std::vector<std::size_t> all_anchors(x.size());
@@ -261,6 +637,21 @@ TEST(WindowTest, Overall) {
         EXPECT_EQ(windows.limits.size(), windows.anchors.size());
     }
 
+    // Searching for the windows with frequency weights.
+    {
+        std::vector<double> weights{ 1, 2, 3, 1, 2, 3, 1, 2, 3, 1, 2, 3 };
+        WeightedLowess::Options<double> opt;
+        opt.delta = 0;
+        opt.weights = weights.data();
+        const auto windows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+        opt.search_windows = true;
+        const auto swindows = WeightedLowess::define_windows(x.size(), x.data(), opt);
+        for (size_t i = 0; i < x.size(); ++i) {
+            EXPECT_EQ(windows.limits[i].left, swindows.limits[i].left);
+            EXPECT_EQ(windows.limits[i].right, swindows.limits[i].right);
+        }
+    }
+
     // Empty. 
     {
         WeightedLowess::Options<double> opt;